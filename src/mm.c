@@ -1,5 +1,14 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 /* The standard allocator interface from stdlib.h.  These are the
  * functions you must implement, more information on each function is
@@ -11,7 +20,10 @@ void *calloc(size_t nmemb, size_t size);
 void *realloc(void *ptr, size_t size);
 
 
-#define DEBUG
+/* Build with -DNDEBUG to silence the debug trace (e.g. for benchmarks) */
+#ifndef NDEBUG
+    #define DEBUG
+#endif
 
 /* Define DEBUG_MESSAGE macro
  * this macro print message when DEBUG is defined*/
@@ -25,6 +37,11 @@ void *realloc(void *ptr, size_t size);
  * increments of CHUNK_SIZE. */
 #define CHUNK_SIZE (1<<12)
 
+/* Each arena takes SLAB_SIZE bytes of heap at a time and carves them
+ * into chunks, so that a slab is bound to its node with a single
+ * mbind(), and neighbouring chunks share one policy and one mapping. */
+#define SLAB_SIZE (1<<21)
+
 /* Double word size. That is the size of block header.*/
 #define DSIZE 8
 
@@ -36,11 +53,44 @@ void *realloc(void *ptr, size_t size);
 /* Put header data (val) to header pointer */
 #define PUT(p, val) (*(p) = (val))
 
-/* Get block size from header pointer */
-#define GET_SIZE(p) (GET(p) & ~0x7)
+/* Get block size from header pointer.  Every block size is a multiple
+ * of 32, which leaves the low 5 bits of a header for flags, and below
+ * 1 << SIZE_BITS, which leaves the high bits for the owner tag of
+ * small blocks. */
+#define SIZE_BITS 48
+#define GET_SIZE(p) (GET(p) & (((size_t)1 << SIZE_BITS) - 1) & ~(size_t)0x1f)
 /* Get block allocation flag from header pointer*/
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+/* Header flag of blocks that are runs of a medium region */
+#define MEDIUM_FLAG 0x2
+/* Get block medium flag from header pointer */
+#define GET_MEDIUM(p) (GET(p) & MEDIUM_FLAG)
+
+/* Header flag of guarded allocations, whose size is that of the mapping */
+#define GUARD_FLAG 0x4
+/* Get block guard flag from header pointer */
+#define GET_GUARD(p) (GET(p) & GUARD_FLAG)
+
+/* Arenas are bound to NUMA nodes.  A thread allocates from the arena of
+ * the node it runs on, and a block is always freed back to the arena
+ * that carved it.  Nodes beyond MAX_ARENAS share arenas. */
+#define MAX_ARENAS 4
+
+/* Header bits 3 and 4 of pool blocks hold the index of the owning arena */
+#define ARENA_SHIFT 3
+/* Get header bits of arena index i */
+#define ARENA_BITS(i) ((size_t)(i) << ARENA_SHIFT)
+/* Get owning arena index from pool block header pointer */
+#define GET_ARENA(p) ((GET(p) >> ARENA_SHIFT) & (MAX_ARENAS - 1))
+
+/* A thread looks up its node again every NODE_REFRESH allocations,
+ * since the scheduler may have migrated it. */
+#define NODE_REFRESH 1024
+
+/* Memory policy mode for mbind(), from linux/mempolicy.h */
+#define MPOL_PREFERRED 1
+
 /* Get next block header pointer from header pointer */
 #define NEXT_HEAD(p) ((Header *)((char *)(p) + GET_SIZE(p)))
 
@@ -54,6 +104,72 @@ void *realloc(void *ptr, size_t size);
 /* Get the block pointer from block header pointer */
 #define BLKP(p)((char *)(p) + DSIZE)
 
+/* Flag of csemalloc_malloc_flags(): return a cache-line-aligned block
+ * pointer for allocations of the 64 byte class and up, and keep 32 byte
+ * class allocations of different threads on different cache lines. */
+#define CSEMALLOC_CACHE_LINE 0x1
+
+/* A line-aligned block pointer starts CACHE_LINE bytes into its block,
+ * with a copy of the block header right in front of it.  Other block
+ * pointers are 8 bytes past a 32 byte aligned block, so the two layouts
+ * tell apart by alignment. */
+#define CACHE_LINE 64
+#define LINE_ALIGNED(bp) ((uintptr_t)(bp) % 32 == 0)
+/* Get the block start header pointer from block pointer of either layout */
+#define BLOCK_HDRP(bp) \
+    (LINE_ALIGNED(bp) ? (Header *)((char *)(bp) - CACHE_LINE) : HDRP(bp))
+
+/* Allocations up to SMALL_SIZE bytes use 32 byte blocks, two per cache
+ * line.  With CSEMALLOC_CACHE_LINE a thread carves them out of its own
+ * lines and keeps up to SMALL_CACHE_MAX free ones to itself. */
+#define SMALL_SIZE (32 - DSIZE)
+#define SMALL_CACHE_MAX 64
+/* Small block headers carry the tag of the thread that carved their
+ * line, so that only that thread caches them when they are freed */
+#define SMALL_TAG(t) ((size_t)(t) << SIZE_BITS)
+#define GET_SMALL_TAG(p) (GET(p) >> SIZE_BITS)
+#define SMALL_TAGS ((1 << (64 - SIZE_BITS)) - 1)
+
+/* Allocations larger than a pool block and up to MEDIUM_MAX bytes are
+ * served from page-granular runs carved out of MEDIUM_REGION_SIZE
+ * regions.  Only larger requests go straight to bulk_alloc(). */
+#define MEDIUM_PAGE (1<<12)
+#define MEDIUM_MAX (1<<20)
+#define MEDIUM_REGION_SIZE (1<<22)
+#define MEDIUM_REGION_PAGES (MEDIUM_REGION_SIZE / MEDIUM_PAGE)
+
+/* Get the page-granular size (header included) of a medium run or bulk
+ * mapping for an allocation of size bytes */
+#define PAGE_RUN_SIZE(size) \
+    (((size) + DSIZE + MEDIUM_PAGE - 1) & ~((size_t)MEDIUM_PAGE - 1))
+/* Guarded allocations end right before a PROT_NONE page of their own
+ * mapping.  Freed ones are poisoned with GUARD_POISON, protected and
+ * kept in a quarantine of up to GUARD_QUARANTINE mappings before they
+ * are unmapped. */
+#define GUARD_PAGE (1<<12)
+#define GUARD_POISON 0xdb
+#define GUARD_QUARANTINE 1024
+
+/* Paths whose latency is recorded when the latency option is on */
+#define LATENCY_FREE_LIST 0    // pool block of the right size was free
+#define LATENCY_SPLIT 1        // pool block was split down to size
+#define LATENCY_EXTEND_HEAP 2  // pool needed sbrk()
+#define LATENCY_BULK_ALLOC 3
+#define LATENCY_BULK_FREE 4
+#define LATENCY_REALLOC_COPY 5
+#define LATENCY_MEDIUM_ALLOC 6 // including any new region mmap()
+#define LATENCY_MEDIUM_FREE 7  // including any region munmap()
+#define LATENCY_PATHS 8
+/* Latency histograms are log-linear: each power of two is split into
+ * 1 << LATENCY_SUB_BITS buckets; the last bucket also holds all
+ * latencies above it */
+#define LATENCY_SUB_BITS 2
+#define LATENCY_BUCKETS 128
+
+/* Get the medium region containing pointer p (regions are size aligned) */
+#define MEDIUM_REGION(p) \
+    ((mediumRegion *)((uintptr_t)(p) & ~((uintptr_t)MEDIUM_REGION_SIZE - 1)))
+
 /*
  * This function, defined in bulk.c, allocates a contiguous memory
  * region of at least size bytes.  It MAY NOT BE USED as the allocator
@@ -109,17 +225,176 @@ struct ExplicitMeta{
 /* define explicit Metadata type*/
 typedef struct ExplicitMeta explicitMeta;
 
-/* It represents explicit free lists
- * It points the last element of the linked list node data structor*/
-static explicitMeta *explicit_free_lists = NULL;
+/* define medium region structor.
+ * next: next region of the arena's medium_regions
+ * arena: index of the owning arena
+ * free_pages: number of unused pages in the region
+ * map: page bitmap, a set bit means the page is in use
+ * The region itself lives in the first page of the region, so that page
+ * is always marked as used.*/
+struct MediumRegion{
+    struct MediumRegion *next;
+    int arena;
+    size_t free_pages;
+    uint64_t map[MEDIUM_REGION_PAGES / 64];
+};
+/* define medium region type*/
+typedef struct MediumRegion mediumRegion;
+
+/* define arena structor.
+ * lock: spinlock guarding the rest of the arena
+ * index: position in arenas, also stored in its pool block headers
+ * free_lists: explicit free lists of the arena, it points the last
+ *             element of the linked list like before
+ * medium_regions: singly linked list of the arena's medium regions
+ * slab, slab_left: next chunk of the arena's current heap slab, and the
+ *             bytes left in it */
+struct Arena{
+    int lock;
+    int index;
+    explicitMeta *free_lists;
+    mediumRegion *medium_regions;
+    char *slab;
+    size_t slab_left;
+};
+/* define arena type*/
+typedef struct Arena arena;
+
+static arena arenas[MAX_ARENAS];
+
+/* Number of NUMA nodes arenas are spread over, 0 until init() ran */
+static int numa_nodes = 0;
+/* Number of NUMA nodes the kernel reports.  Only these are passed to
+ * mbind(); nodes of a larger fake topology are not. */
+static int real_numa_nodes = 1;
+
+/* Guards sbrk(), whose heap all arenas share */
+static int heap_lock = 0;
+/* Registers the fork() handlers once */
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+/* Node of the calling thread and allocations left until it is looked up
+ * again */
+static __thread int thread_node = 0;
+static __thread int thread_node_ttl = 0;
+/* Node the calling thread was pinned to with the thread_node option, or
+ * -1 to follow the scheduler */
+static __thread int thread_pinned_node = -1;
+
+/* When zero, medium allocations fall back to bulk_alloc() */
+static long medium_enabled = 1;
+
+/* When nonzero, malloc() behaves as if passed CSEMALLOC_CACHE_LINE */
+static long cache_align = 0;
+
+/* When nonzero, one in guard_rate allocations is guarded */
+static long guard_rate = 0;
+/* Milliseconds a freed guarded allocation stays in quarantine */
+static long guard_quarantine_ms = 1000;
+/* Allocations the calling thread makes until the next guarded one, or
+ * 0 until guard_seed() picks its first */
+static __thread long thread_guard_countdown = 0;
+
+/* Ring of quarantined mappings, oldest at head */
+static struct {
+    int lock;
+    size_t head;
+    size_t count;
+    struct {
+        char *base;
+        size_t size;
+        long freed_ms;
+    } slots[GUARD_QUARANTINE];
+} quarantine;
+
+/* When nonzero, the latency of each path is recorded */
+static long latency_enabled = 0;
+
+/* Per-thread latency histograms.  Only the owning thread writes its
+ * counts; a thread that exits leaves them to the next thread that
+ * claims the histogram, so they still add to the totals. */
+typedef struct latencyHist{
+    int owner;
+    struct latencyHist *next;
+    size_t counts[LATENCY_PATHS][LATENCY_BUCKETS];
+} latencyHist;
+
+/* Every histogram ever mapped, newest first; entries are never removed */
+static latencyHist *latency_hists = NULL;
+/* Histogram of the calling thread */
+static __thread latencyHist *thread_latency = NULL;
+/* Key whose destructor releases the histogram of exiting threads */
+static pthread_key_t latency_key;
+static pthread_once_t latency_once = PTHREAD_ONCE_INIT;
+
+/* Names of latency paths in csemalloc_stat() */
+static const char *latency_paths[LATENCY_PATHS] = {
+    "free_list", "split", "extend_heap", "bulk_alloc", "bulk_free",
+    "realloc_copy", "medium_alloc", "medium_free"
+};
+
+/* Free 32 byte blocks kept by the calling thread, linked through their
+ * block pointers, and their number */
+static __thread Header *thread_small_blocks = NULL;
+static __thread int thread_small_count = 0;
+/* Nonzero tag of the lines the calling thread carved, once it did */
+static __thread size_t thread_small_tag = 0;
+/* Small block tags handed out so far */
+static size_t small_tags = 0;
+/* Nonzero once the calling thread registered small_cache_flush() */
+static __thread int thread_small_registered = 0;
+
+/* Key whose destructor flushes the small block cache of exiting threads */
+static pthread_key_t small_cache_key;
+static pthread_once_t small_cache_once = PTHREAD_ONCE_INIT;
+
+/* Counters reported by csemalloc_stat() */
+static struct {
+    size_t sbrk_calls;
+    size_t mmap_calls;
+    size_t munmap_calls;
+    size_t medium_regions;
+    size_t medium_allocs;
+    size_t bulk_allocs;
+    size_t mbind_calls;
+    size_t guard_allocs;
+    size_t guard_frees;
+} stats;
+
+/* Add n to the counter called field; counters are updated without locks */
+#define STAT_ADD(field, n) __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+/* Subtract n from the counter called field */
+#define STAT_SUB(field, n) __atomic_fetch_sub(&stats.field, (n), __ATOMIC_RELAXED)
 
 
-extern void *sbrk(int increments);
 int block_index(size_t x);
-int init(void);
-static void *find_free_block(size_t asize);
-static Header *extend_heap();
-static void place(Header* hp, size_t asize);
+static int init(void);
+static arena *current_arena();
+static void spin_lock(int *lock);
+static void spin_unlock(int *lock);
+static void *find_free_block(arena *a, size_t asize);
+static Header *extend_heap(arena *a);
+static void place(arena *a, Header* hp, size_t asize);
+static void remove_free_block(arena *a, Header *hp);
+static Header *medium_alloc(arena *a, size_t asize);
+static void medium_free(Header *hp);
+static int medium_resize(Header *hp, size_t asize);
+static void *map_memory(size_t size);
+static void unmap_memory(void *ptr, size_t size);
+static void *map_pages(size_t size);
+static void unmap_pages(void *ptr, size_t size);
+static void bind_memory(void *ptr, size_t size, arena *a);
+static void *allocate(size_t size, int flags);
+static void *small_alloc(arena *a);
+static int small_cache_push(Header *hp);
+static void pool_free(Header *hp);
+static void *guard_alloc(arena *a, size_t size, int flags);
+static void guard_free(void *ptr);
+static size_t guard_capacity(void *ptr);
+static long guard_seed(void);
+static uint64_t read_cycles(void);
+static uint64_t latency_start(void);
+static void latency_record(int path, uint64_t start);
 
 /* THIS MACRO PRINT BLOCK INFORMATION FOR DEBUG
  * hp: block header pointer
@@ -140,10 +415,10 @@ static void place(Header* hp, size_t asize);
 /* Print all free block list for debug
  **/
 #ifdef DEBUG
-    static void printFreeBlockList(char *prefix){
+    static void printFreeBlockList(arena *a, char *prefix){
         DEBUG_MESSAGE("\n%s", prefix);
         DEBUG_MESSAGE("------Free Block List --------");
-        if(explicit_free_lists == NULL){
+        if(a -> free_lists == NULL){
             DEBUG_MESSAGE("\n%s", prefix);
             DEBUG_MESSAGE("\tNo Free Block");
             DEBUG_MESSAGE("\n%s", prefix);
@@ -151,8 +426,8 @@ static void place(Header* hp, size_t asize);
             return;
         }
         Header *p, *prevp;
-        p = HDRP(explicit_free_lists);
-        prevp = explicit_free_lists -> pred;
+        p = HDRP(a -> free_lists);
+        prevp = a -> free_lists -> pred;
         while(prevp != p){
             DEBUG_MESSAGE("\n%s", prefix);
             DEBUG_MESSAGE("******FREE BLOCK******");
@@ -174,17 +449,51 @@ static void place(Header* hp, size_t asize);
 #endif
 
 
+/* Return the block pointer offset bytes into block hp, copying the
+ * header in front of it if that is not the block start */
+static void *block_pointer(Header *hp, size_t offset){
+    char *bp = (char *)hp + offset;
+    PUT(HDRP(bp), GET(hp));
+    return bp;
+}
+
 /*
  * You must implement malloc().  Your implementation of malloc() must be
  * the multi-pool allocator described in the project handout.
  */
 void *malloc(size_t size) {
+    //detect NUMA nodes and options on first use
+    if(numa_nodes == 0) init();
+    return allocate(size, cache_align ? CSEMALLOC_CACHE_LINE : 0);
+}
+
+/* Allocate size bytes as malloc() does, honoring CSEMALLOC_* flags */
+static void *allocate(size_t size, int flags){
     DEBUG_MESSAGE("\n-------Start Malloc------");
-    #ifdef DEBUG
-        printFreeBlockList("\t");
-    #endif
-    //if size is zero
-    if(size == 0) return NULL;
+    //if size is zero, or so large that the block sizes below wrap
+    if(size == 0 || size > SIZE_MAX - CACHE_LINE - MEDIUM_PAGE) return NULL;
+    uint64_t start = latency_start();
+    // use the arena of the node this thread runs on
+    arena *a = current_arena();
+    DEBUG_MESSAGE("\n\tArena: %d", a -> index);
+    //if this allocation is sampled for a guard page
+    if(guard_rate > 0 && thread_guard_countdown == 0){
+        thread_guard_countdown = guard_seed();
+    }
+    if(guard_rate > 0 && --thread_guard_countdown == 0){
+        thread_guard_countdown = guard_rate;
+        DEBUG_MESSAGE("\n\tGuarded Allocation");
+        return guard_alloc(a, size, flags);
+    }
+    //if size is small and should stay on this thread's cache lines
+    if((flags & CSEMALLOC_CACHE_LINE) && size <= SMALL_SIZE){
+        DEBUG_MESSAGE("\n\tThread Small Block");
+        return small_alloc(a);
+    }
+    // offset of the block pointer in its block; a line-aligned block
+    // holds size bytes plus one cache line
+    size_t offset = (flags & CSEMALLOC_CACHE_LINE) ? CACHE_LINE : DSIZE;
+    size += offset - DSIZE;
     // calculate desire align size
     size_t asize = 1 << block_index(size);
     Header * hp;
@@ -195,47 +504,76 @@ void *malloc(size_t size) {
 
     //if size is large
     if(size > CHUNK_SIZE - DSIZE){
+        //if size is medium
+        if(medium_enabled && size <= MEDIUM_MAX){
+            DEBUG_MESSAGE("\n");
+            DEBUG_MESSAGE("\n\tMedium runs are used for medium allocations");
+            //carve a page run out of a medium region
+            asize = PAGE_RUN_SIZE(size);
+            if((hp = medium_alloc(a, asize)) == NULL) return NULL;
+            DEBUG_MESSAGE("\n\t*********Malloc Result*********");
+            PRINT_BLOCK_INFO(hp, "\t");
+            DEBUG_MESSAGE("\n\t*********************************");
+            DEBUG_MESSAGE("\n--------------End Malloc-------------");
+            void *bp = block_pointer(hp, offset);
+            latency_record(LATENCY_MEDIUM_ALLOC, start);
+            //return block pointer
+            return bp;
+        }
         DEBUG_MESSAGE("\n");
         DEBUG_MESSAGE("\n\tBulk allocations are used for large allocations");
-        //using bulk_alloc
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE + 1)) / DSIZE);
-        hp =(Header *) bulk_alloc(asize);
+        //using bulk_alloc, whose mappings are page granular anyway
+        asize = PAGE_RUN_SIZE(size);
+        if((hp = (Header *) map_memory(asize)) == NULL) return NULL;
+        // bind before the header write touches the first page
+        bind_memory(hp, asize, a);
+        STAT_ADD(bulk_allocs, 1);
         //Set header
         PUT(hp, PACK(asize, 1));
         DEBUG_MESSAGE("\n\t*********Malloc Result*********");
         PRINT_BLOCK_INFO(hp, "\t");
         DEBUG_MESSAGE("\n\t*********************************");
         DEBUG_MESSAGE("\n--------------End Malloc-------------");
+        void *bp = block_pointer(hp, offset);
+        latency_record(LATENCY_BULK_ALLOC, start);
         //return block pointer
-        return BLKP(hp);
+        return bp;
     }
     
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n\t...Find Fit Free Block");
 
+    spin_lock(&a -> lock);
+    #ifdef DEBUG
+        printFreeBlockList(a, "\t");
+    #endif
     //find free block to fit align size
-    if((hp = find_free_block(asize)) != NULL){
+    if((hp = find_free_block(a, asize)) != NULL){
         //if found fit block
         DEBUG_MESSAGE("\n\t\t*******Fit Free Block********");
         PRINT_BLOCK_INFO(hp, "\t\t");
         DEBUG_MESSAGE("\n\t\t*****************************");
 
         DEBUG_MESSAGE("\n\t...Place Align Size Block");
+        int path = GET_SIZE(hp) == asize ? LATENCY_FREE_LIST : LATENCY_SPLIT;
         //place align size block to free block
-        place(hp, asize);
+        place(a, hp, asize);
 
         DEBUG_MESSAGE("\n");
         DEBUG_MESSAGE("\n\t#########Malloc Result###########");
         #ifdef DEBUG
-            printFreeBlockList("\t");
+            printFreeBlockList(a, "\t");
         #endif
+        spin_unlock(&a -> lock);
         DEBUG_MESSAGE("\n");
         DEBUG_MESSAGE("\n\t**********Result Block***********");
         PRINT_BLOCK_INFO(hp, "\t");
         DEBUG_MESSAGE("\n\t*********************************");
         DEBUG_MESSAGE("\n--------------End Malloc--------------------");
+        void *bp = block_pointer(hp, offset);
+        latency_record(path, start);
         //return block pointer
-        return BLKP(hp);
+        return bp;
     }
 
     //if not found free block to fit align size
@@ -243,7 +581,10 @@ void *malloc(size_t size) {
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n\t...Extend Heap");
     //extend heap;
-    if((hp = extend_heap()) == NULL) return NULL;
+    if((hp = extend_heap(a)) == NULL){
+        spin_unlock(&a -> lock);
+        return NULL;
+    }
 
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n\t\t*******Extended Block******");
@@ -251,25 +592,28 @@ void *malloc(size_t size) {
     DEBUG_MESSAGE("\n\t\t***************************");
     DEBUG_MESSAGE("\n\t...Place Align Size Block");
     //place align size block to extended block
-    place(hp, asize);
+    place(a, hp, asize);
 
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n\t#########Malloc Result###########");
     #ifdef DEBUG
-        printFreeBlockList("\t");
+        printFreeBlockList(a, "\t");
     #endif
+    spin_unlock(&a -> lock);
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n\t**********Result Block***********");
     PRINT_BLOCK_INFO(hp, "\t");
     DEBUG_MESSAGE("\n\t*********************************");
     DEBUG_MESSAGE("\n--------------End Malloc--------------------");
+    void *bp = block_pointer(hp, offset);
+    latency_record(LATENCY_EXTEND_HEAP, start);
     //return block pointer
-    return BLKP(hp);
+    return bp;
 }
 
 /* Split Free block to two Free block
 */
-static Header * split_free_block(Header * hp){
+static Header * split_free_block(arena *a, Header * hp){
     size_t size = GET_SIZE(hp);
     //if size < 32
     if (size <= 1 << 5){
@@ -287,11 +631,11 @@ static Header * split_free_block(Header * hp){
     //get explicit metadata of successor block
     explicitMeta *succExMeta = (explicitMeta *)BLKP(succ);
     // set block size as half of origin size
-    PUT(hp, PACK(half_size, 0));
+    PUT(hp, PACK(half_size, ARENA_BITS(a -> index)));
     // get next half block header pointer
     Header *next_hp = NEXT_HEAD(hp);
     // set next block size as half of origin size 
-    PUT(next_hp, PACK(half_size, 0));
+    PUT(next_hp, PACK(half_size, ARENA_BITS(a -> index)));
     // get next block explicit Metadata
     explicitMeta *nextExMeta = (explicitMeta *)BLKP(next_hp);
     
@@ -315,9 +659,9 @@ static Header * split_free_block(Header * hp){
         nextExMeta -> pred = hp;
         // set successor of second half block as itself(second half block)
         nextExMeta -> succ = next_hp;
-        // set explicit_free_lists as metadata of second half block
+        // set free_lists as metadata of second half block
         //(setting last node of explicit free lists)
-        explicit_free_lists = nextExMeta;
+        a -> free_lists = nextExMeta;
     }
 
     DEBUG_MESSAGE("\n\t\t\tSplit %ld bytes block at %p to two %ld bytes blocks at %p, %p", size, hp, half_size, hp, next_hp);
@@ -325,15 +669,27 @@ static Header * split_free_block(Header * hp){
     return hp;
 }
 
-static void place(Header* hp, size_t asize){
+static void place(arena *a, Header* hp, size_t asize){
     DEBUG_MESSAGE("\n\t\t---------start place------------");
     size_t size = GET_SIZE(hp);
     //split block until first block equals asize;
     while(size > asize){
-        hp = split_free_block(hp);
+        hp = split_free_block(a, hp);
         size = GET_SIZE(hp);
     }
-    
+
+    DEBUG_MESSAGE("\n");
+    DEBUG_MESSAGE("\n\t\t\t...Set Allocation Flag as 1");
+    // set header to allocated
+    PUT(hp, PACK(asize, ARENA_BITS(a -> index) | 1));
+
+    DEBUG_MESSAGE("\n\t\t\t...Set Explicit Metadata");
+    remove_free_block(a, hp);
+    DEBUG_MESSAGE("\n\t\t--------End Place-------------");
+}
+
+/* Unlink free block hp from the explicit free lists of arena a */
+static void remove_free_block(arena *a, Header *hp){
     // get explicit metadata
     explicitMeta *exMeta = (explicitMeta *)BLKP(hp);
     // get predecessor block header pointer
@@ -344,13 +700,6 @@ static void place(Header* hp, size_t asize){
     explicitMeta *predExMeta = (explicitMeta *)BLKP(pred);
     // get explicit metadata of successor
     explicitMeta *succExMeta = (explicitMeta *)BLKP(succ);
-
-    DEBUG_MESSAGE("\n");
-    DEBUG_MESSAGE("\n\t\t\t...Set Allocation Flag as 1");
-    // set header to allocated
-    PUT(hp, PACK(asize, 1));
-
-    DEBUG_MESSAGE("\n\t\t\t...Set Explicit Metadata");
     // reset explicit metadatas
     //if predecessor not equal origin block and successor not equal origin block
     if(pred != hp && succ != hp){
@@ -361,31 +710,29 @@ static void place(Header* hp, size_t asize){
     }else if(pred != hp && succ == hp){ //it means origin block is the last node of explicit free lists
         //set successor of predecessor as itself(origin predecessor)
         predExMeta -> succ = pred;
-        // set explicit_free_lists as explicit metadata of origin predecessor
-        explicit_free_lists = predExMeta;
+        // set free_lists as explicit metadata of origin predecessor
+        a -> free_lists = predExMeta;
     //if predecessor equals origin block and successor not equals predecessor    
     }else if(pred == hp && succ != hp){ //it means origin block is the first node of explicit free lists
         // set predecessor of successor as itself(origin successor);
         succExMeta -> pred = succ;
     //else
     }else{ // it means there was only one free block
-        // set explicit_free_lists as Null
-        explicit_free_lists = NULL;
+        // set free_lists as Null
+        a -> free_lists = NULL;
     }
-    
-    DEBUG_MESSAGE("\n\t\t--------End Place-------------");
 }
 
-static void *find_free_block(size_t asize){
+static void *find_free_block(arena *a, size_t asize){
     Header *p, *prevp;
     //if no free block
-    if(explicit_free_lists == NULL){
+    if(a -> free_lists == NULL){
         return NULL;
     }
     //initial p as last node of explicit free lists
-    p = explicit_free_lists -> succ;
+    p = a -> free_lists -> succ;
     // set prevp as predecessor of p
-    prevp = explicit_free_lists -> pred;
+    prevp = a -> free_lists -> pred;
     // iterate over explicit free lists
     while(prevp != p){
         //if block size >= asize
@@ -406,46 +753,70 @@ static void *find_free_block(size_t asize){
     return NULL;
 }
 
-static Header *extend_heap(){
+static Header *extend_heap(arena *a){
     DEBUG_MESSAGE("\n\t\t-------------Start Extend Heap---------------");
     DEBUG_MESSAGE("\n\t\t\tsbrk(0) : %p", sbrk(0));
     DEBUG_MESSAGE("\n\t\t\t...Create new block");
 
-    //request new CHUNK_SIZE memory
-    void *p = sbrk(CHUNK_SIZE);
-    if(p ==(void *) -1){
-        return NULL;
+    //take a new slab when the arena's is used up
+    if(a -> slab_left == 0){
+        // the heap is shared by all arenas
+        spin_lock(&heap_lock);
+        // keep slabs page aligned, so each can be bound to a node
+        size_t pad = (CHUNK_SIZE - (uintptr_t)sbrk(0) % CHUNK_SIZE) % CHUNK_SIZE;
+        if(pad > 0){
+            STAT_ADD(sbrk_calls, 1);
+            if(sbrk(pad) == (void *) -1){
+                spin_unlock(&heap_lock);
+                return NULL;
+            }
+        }
+        //request new SLAB_SIZE memory
+        void *slab = sbrk(SLAB_SIZE);
+        STAT_ADD(sbrk_calls, 1);
+        spin_unlock(&heap_lock);
+        if(slab == (void *) -1){
+            return NULL;
+        }
+        // bind before any header write touches the slab
+        bind_memory(slab, SLAB_SIZE, a);
+        a -> slab = slab;
+        a -> slab_left = SLAB_SIZE;
     }
+    //carve next CHUNK_SIZE chunk off the slab
+    void *p = a -> slab;
+    a -> slab += CHUNK_SIZE;
+    a -> slab_left -= CHUNK_SIZE;
     // create new free block with CHUNK_SIZE
     Header *hp = (Header *)p;
-    PUT(hp, PACK(CHUNK_SIZE, 0));
+    PUT(hp, PACK(CHUNK_SIZE, ARENA_BITS(a -> index)));
     
     PRINT_BLOCK_INFO(hp, "\t\t\t\t");
     DEBUG_MESSAGE("\n\t\t\t...Update Explicit Free Lists");
     // get explicit metadata of new block
     explicitMeta* exMeta = (explicitMeta *)BLKP(hp);
     // set explicit metadata
-    //if explicit_free_lists == NULL
-    if(explicit_free_lists == NULL){ //there's no free block
+    //if free_lists == NULL
+    if(a -> free_lists == NULL){ //there's no free block
         // set predecessor and successor as itself
         exMeta -> pred = hp;
         exMeta -> succ = hp;
         // set explicit_free_list as explicit metadata of new block
-        explicit_free_lists = exMeta;
+        a -> free_lists = exMeta;
     //else
     }else{
         //add new node to the last of explicit free lists
         //set predecessor of new block as origin last free block
-        exMeta -> pred = explicit_free_lists -> succ;
+        exMeta -> pred = a -> free_lists -> succ;
         //set successor of origin last free block as new block
-        explicit_free_lists -> succ = hp;
+        a -> free_lists -> succ = hp;
         //set successor of new block as itself
         exMeta-> succ = hp;
-        // set explicit_free_lists as explicit metadata of new block
-        explicit_free_lists = exMeta;
+        // set free_lists as explicit metadata of new block
+        a -> free_lists = exMeta;
     }
     #ifdef DEBUG
-        printFreeBlockList("\t\t\t\t");
+        printFreeBlockList(a, "\t\t\t\t");
     #endif
 
     DEBUG_MESSAGE("\n\t\t------------End Extend Heap----------------");
@@ -453,7 +824,717 @@ static Header *extend_heap(){
     return hp;
 }
 
+/* Flush the small block cache of an exiting thread to the arenas */
+static void small_cache_flush(void *unused){
+    while(thread_small_blocks != NULL){
+        Header *hp = thread_small_blocks;
+        thread_small_blocks = *(Header **)BLKP(hp);
+        pool_free(hp);
+    }
+    thread_small_count = 0;
+}
+
+static void small_cache_key_init(){
+    pthread_key_create(&small_cache_key, small_cache_flush);
+}
+
+/* Keep 32 byte block hp in the calling thread's cache.  Returns zero
+ * if the cache is full, or if hp is not a small block this thread
+ * carved for its current arena: the other half of its line may be in
+ * use by another thread, or it belongs to another node. */
+static int small_cache_push(Header *hp){
+    if(thread_small_count >= SMALL_CACHE_MAX
+       || thread_small_tag == 0 || GET_SMALL_TAG(hp) != thread_small_tag
+       || GET_ARENA(hp) != current_arena() -> index){
+        return 0;
+    }
+    //flush the cache when the thread exits
+    if(!thread_small_registered){
+        pthread_once(&small_cache_once, small_cache_key_init);
+        pthread_setspecific(small_cache_key, &thread_small_registered);
+        thread_small_registered = 1;
+    }
+    *(Header **)BLKP(hp) = thread_small_blocks;
+    thread_small_blocks = hp;
+    thread_small_count++;
+    return 1;
+}
+
+/* Allocate a 32 byte block from the calling thread's cache.  When it is
+ * empty, take a whole cache line from arena a and split it into two 32
+ * byte blocks tagged with this thread, caching the second, so the line
+ * is this thread's alone.  Blocks freed by other threads go back to
+ * the pool, and only return to a thread's cache from the pool as part
+ * of a whole line. */
+static void *small_alloc(arena *a){
+    Header *hp = thread_small_blocks;
+    if(hp != NULL){
+        thread_small_blocks = *(Header **)BLKP(hp);
+        thread_small_count--;
+        return BLKP(hp);
+    }
+    spin_lock(&a -> lock);
+    //take a free cache line block, extending heap if there's none
+    if((hp = find_free_block(a, CACHE_LINE)) == NULL
+       && (hp = extend_heap(a)) == NULL){
+        spin_unlock(&a -> lock);
+        return NULL;
+    }
+    place(a, hp, CACHE_LINE);
+    spin_unlock(&a -> lock);
+    if(thread_small_tag == 0){
+        thread_small_tag = __atomic_add_fetch(&small_tags, 1, __ATOMIC_RELAXED)
+                           % SMALL_TAGS + 1;
+    }
+    // split line in two allocated 32 byte blocks
+    Header *second = (Header *)((char *)hp + CACHE_LINE / 2);
+    size_t tag = SMALL_TAG(thread_small_tag);
+    PUT(hp, PACK(CACHE_LINE / 2 | tag, ARENA_BITS(a -> index) | 1));
+    PUT(second, PACK(CACHE_LINE / 2 | tag, ARENA_BITS(a -> index) | 1));
+    if(!small_cache_push(second)){
+        pool_free(second);
+    }
+    return BLKP(hp);
+}
+
+/* Return a monotonic clock in milliseconds */
+static long now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Unmap quarantined mappings freed guard_quarantine_ms or more before
+ * now, and the oldest ones until at most keep are left.  The caller
+ * holds the quarantine lock. */
+static void quarantine_expire(long now, size_t keep){
+    while(quarantine.count > 0){
+        size_t head = quarantine.head;
+        if(quarantine.count <= keep
+           && now - quarantine.slots[head].freed_ms < guard_quarantine_ms){
+            break;
+        }
+        unmap_memory(quarantine.slots[head].base, quarantine.slots[head].size);
+        quarantine.head = (head + 1) % GUARD_QUARANTINE;
+        quarantine.count--;
+    }
+}
+
+/* Pick the first countdown of the calling thread, 1 to guard_rate, at a
+ * random offset, so that a thread's first allocations are no likelier
+ * to be guarded than any other */
+static long guard_seed(void){
+    static uint64_t seeds = 0;
+    uint64_t x = __atomic_add_fetch(&seeds, 1, __ATOMIC_RELAXED)
+                 ^ (uintptr_t)&thread_guard_countdown ^ read_cycles();
+    //finish with a splitmix64 round
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return 1 + x % (uint64_t)guard_rate;
+}
+
+/* Allocate size bytes at the end of a mapping of their own, right
+ * before a PROT_NONE guard page, so that an overrun faults at once.
+ * The block pointer is aligned to DSIZE, or to a cache line with
+ * CSEMALLOC_CACHE_LINE, which may leave a few bytes of slack. */
+static void *guard_alloc(arena *a, size_t size, int flags){
+    DEBUG_MESSAGE("\n\t\t---------Start Guard Alloc------------");
+    size_t align = (flags & CSEMALLOC_CACHE_LINE) ? CACHE_LINE : DSIZE;
+    // sizes this large would wrap around below
+    if(size > SIZE_MAX - align - DSIZE - MEDIUM_PAGE - GUARD_PAGE){
+        return NULL;
+    }
+    // the block ends at the guard page once rounded up to align, and
+    // the data pages hold it and its header, which stays in the first
+    // page so that guard_base() finds the mapping
+    size_t rounded = (size + align - 1) & ~(align - 1);
+    size_t data = PAGE_RUN_SIZE(rounded);
+    size_t mapping = data + GUARD_PAGE;
+    // release expired quarantine first, it may be a while until a free
+    spin_lock(&quarantine.lock);
+    quarantine_expire(now_ms(), GUARD_QUARANTINE);
+    spin_unlock(&quarantine.lock);
+    char *base = map_memory(mapping);
+    if(base == NULL){
+        return NULL;
+    }
+    bind_memory(base, mapping, a);
+    if(mprotect(base + data, GUARD_PAGE, PROT_NONE) != 0){
+        unmap_memory(base, mapping);
+        return NULL;
+    }
+    char *bp = base + data - rounded;
+    PUT(HDRP(bp), PACK(mapping, GUARD_FLAG | 1));
+    STAT_ADD(guard_allocs, 1);
+    DEBUG_MESSAGE("\n\t\t\tBlock Pointer %p, Guard Page %p", bp, base + data);
+    DEBUG_MESSAGE("\n\t\t---------End Guard Alloc--------------");
+    return bp;
+}
+
+/* Get the first byte of the mapping of guarded block pointer ptr; its
+ * header always lies in the first page */
+static char *guard_base(void *ptr){
+    return (char *)((uintptr_t)HDRP(ptr) & ~((uintptr_t)GUARD_PAGE - 1));
+}
+
+/* Return the bytes guarded block pointer ptr holds up to its guard page */
+static size_t guard_capacity(void *ptr){
+    size_t data = GET_SIZE(HDRP(ptr)) - GUARD_PAGE;
+    return guard_base(ptr) + data - (char *)ptr;
+}
+
+/* Poison and protect the mapping of guarded block pointer ptr, so that
+ * a use after free faults, and quarantine it */
+static void guard_free(void *ptr){
+    Header *hp = HDRP(ptr);
+    size_t mapping = GET_SIZE(hp);
+    char *base = guard_base(ptr);
+    size_t data = mapping - GUARD_PAGE;
+    memset(hp, GUARD_POISON, base + data - (char *)hp);
+    mprotect(base, data, PROT_NONE);
+    STAT_ADD(guard_frees, 1);
+    long now = now_ms();
+    spin_lock(&quarantine.lock);
+    //make room, then push to tail
+    quarantine_expire(now, GUARD_QUARANTINE - 1);
+    size_t tail = (quarantine.head + quarantine.count) % GUARD_QUARANTINE;
+    quarantine.slots[tail].base = base;
+    quarantine.slots[tail].size = mapping;
+    quarantine.slots[tail].freed_ms = now;
+    quarantine.count++;
+    spin_unlock(&quarantine.lock);
+}
+
+/* Read a timestamp for latency histograms: the time stamp counter on
+ * x86, nanoseconds elsewhere */
+static uint64_t read_cycles(void){
+    #if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    #endif
+}
+
+/* Return the start timestamp of an operation, or 0 when latency is not
+ * recorded */
+static uint64_t latency_start(void){
+    return latency_enabled ? read_cycles() : 0;
+}
+
+/* Return the histogram bucket of a latency of cycles.  Latencies below
+ * 1 << LATENCY_SUB_BITS have a bucket each; above, the top
+ * LATENCY_SUB_BITS bits after the leading one pick the bucket. */
+static int latency_bucket(uint64_t cycles){
+    if(cycles < (1 << LATENCY_SUB_BITS)){
+        return cycles;
+    }
+    int msb = 63 - __builtin_clzll(cycles);
+    int sub = (cycles >> (msb - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+    int bucket = ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/* Return the smallest latency that falls into bucket */
+static uint64_t latency_bucket_min(int bucket){
+    if(bucket < (1 << LATENCY_SUB_BITS)){
+        return bucket;
+    }
+    int msb = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+    return ((1 << LATENCY_SUB_BITS) + sub) << (msb - LATENCY_SUB_BITS);
+}
+
+/* Release the histogram of an exiting thread to later threads */
+static void latency_release(void *hist){
+    __atomic_store_n(&((latencyHist *)hist) -> owner, 0, __ATOMIC_RELEASE);
+}
+
+static void latency_key_create(void){
+    pthread_key_create(&latency_key, latency_release);
+}
+
+/* Claim a released histogram for the calling thread, or map a new one */
+static latencyHist *latency_attach(void){
+    latencyHist *h = __atomic_load_n(&latency_hists, __ATOMIC_ACQUIRE);
+    for(; h != NULL; h = h -> next){
+        int free_owner = 0;
+        if(__atomic_compare_exchange_n(&h -> owner, &free_owner, 1, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+            break;
+        }
+    }
+    if(h == NULL){
+        //mapped memory is zeroed; it's never freed, and not counted in
+        //mmap_calls, which latency is meant to explain
+        if((h = bulk_alloc(sizeof(latencyHist))) == NULL) return NULL;
+        h -> owner = 1;
+        h -> next = __atomic_load_n(&latency_hists, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&latency_hists, &h -> next, h, 0,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    // set before the key, whose value may be malloc()ed
+    thread_latency = h;
+    pthread_once(&latency_once, latency_key_create);
+    pthread_setspecific(latency_key, h);
+    return h;
+}
+
+/* Record the latency of an operation on path begun at start, as
+ * returned by latency_start() */
+static void latency_record(int path, uint64_t start){
+    if(start == 0) return;
+    uint64_t cycles = read_cycles() - start;
+    latencyHist *h = thread_latency;
+    if(h == NULL && (h = latency_attach()) == NULL) return;
+    // only this thread writes, readers just need untorn counts
+    size_t *count = &h -> counts[path][latency_bucket(cycles)];
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+}
+
+/* Read latency counter name, without its "latency." prefix, summed over
+ * all threads into *value.  Returns 0 on success, or -1 if there is no
+ * such counter. */
+static int latency_stat(const char *name, size_t *value){
+    char *end;
+    if(strcmp(name, "buckets") == 0){
+        *value = LATENCY_BUCKETS;
+        return 0;
+    }
+    if(strncmp(name, "bucket.", 7) == 0){
+        long bucket = strtol(name + 7, &end, 10);
+        if(end == name + 7 || *end != '\0' || bucket < 0 || bucket >= LATENCY_BUCKETS){
+            return -1;
+        }
+        *value = latency_bucket_min(bucket);
+        return 0;
+    }
+    for(int path = 0; path < LATENCY_PATHS; path++){
+        size_t len = strlen(latency_paths[path]);
+        if(strncmp(name, latency_paths[path], len) != 0 || name[len] != '.'){
+            continue;
+        }
+        const char *field = name + len + 1;
+        size_t counts[LATENCY_BUCKETS] = { 0 };
+        size_t total = 0;
+        latencyHist *h = __atomic_load_n(&latency_hists, __ATOMIC_ACQUIRE);
+        for(; h != NULL; h = h -> next){
+            for(int i = 0; i < LATENCY_BUCKETS; i++){
+                size_t n = __atomic_load_n(&h -> counts[path][i], __ATOMIC_RELAXED);
+                counts[i] += n;
+                total += n;
+            }
+        }
+        if(strcmp(field, "count") == 0){
+            *value = total;
+            return 0;
+        }
+        // percentiles are given in tenths of a percent
+        long permille = 0;
+        if(strcmp(field, "p50") == 0) permille = 500;
+        if(strcmp(field, "p99") == 0) permille = 990;
+        if(strcmp(field, "p999") == 0) permille = 999;
+        if(permille != 0){
+            //smallest latency of the bucket holding the percentile
+            size_t rank = (total * permille + 999) / 1000;
+            size_t seen = 0;
+            *value = 0;
+            for(int i = 0; i < LATENCY_BUCKETS && total > 0; i++){
+                seen += counts[i];
+                if(seen >= rank){
+                    *value = latency_bucket_min(i);
+                    break;
+                }
+            }
+            return 0;
+        }
+        long bucket = strtol(field, &end, 10);
+        if(end == field || *end != '\0' || bucket < 0 || bucket >= LATENCY_BUCKETS){
+            return -1;
+        }
+        *value = counts[bucket];
+        return 0;
+    }
+    return -1;
+}
+
+/* Map size bytes with bulk_alloc(), counting the mmap() it costs */
+static void *map_memory(size_t size){
+    STAT_ADD(mmap_calls, 1);
+    return bulk_alloc(size);
+}
+
+/* Unmap memory obtained from map_memory(), counting the munmap() it costs */
+static void unmap_memory(void *ptr, size_t size){
+    STAT_ADD(munmap_calls, 1);
+    bulk_free(ptr, size);
+}
+
+/* Map size bytes with mmap() itself, counting it.  Medium regions are
+ * trimmed and unmapped piecewise, which bulk_free() does not allow, so
+ * they don't use map_memory(). */
+static void *map_pages(size_t size){
+    STAT_ADD(mmap_calls, 1);
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/* Unmap any page range within memory from map_pages(), counting it */
+static void unmap_pages(void *ptr, size_t size){
+    STAT_ADD(munmap_calls, 1);
+    munmap(ptr, size);
+}
+
+/* Take spinlock lock, yielding the CPU while another thread holds it */
+static void spin_lock(int *lock){
+    while(__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)){
+        while(__atomic_load_n(lock, __ATOMIC_RELAXED)){
+            sched_yield();
+        }
+    }
+}
+
+/* Release spinlock lock */
+static void spin_unlock(int *lock){
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Return the number of NUMA nodes the kernel has online, or 1 if it
+ * can't tell.  The online list looks like "0-1", so the last number in
+ * it is the highest node. */
+static int detect_numa_nodes(){
+    char buf[64];
+    int fd = open("/sys/devices/system/node/online", O_RDONLY);
+    if(fd < 0){
+        return 1;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(n <= 0){
+        return 1;
+    }
+    buf[n] = '\0';
+    char *p = buf + n;
+    //skip trailing newline, then back up to the start of the last number
+    while(p > buf && (p[-1] < '0' || p[-1] > '9')) p--;
+    while(p > buf && p[-1] >= '0' && p[-1] <= '9') p--;
+    return atoi(p) + 1;
+}
+
+/* Spread arenas over nodes NUMA nodes, clamped to 1..MAX_ARENAS */
+static void set_numa_nodes(long nodes){
+    if(nodes < 1) nodes = 1;
+    if(nodes > MAX_ARENAS) nodes = MAX_ARENAS;
+    numa_nodes = nodes;
+}
+
+/* Take every allocator lock before fork(), so that no other thread
+ * holds one in the child.  Arena locks come first, as extend_heap()
+ * takes heap_lock under one. */
+static void fork_prepare(void){
+    for(int i = 0; i < MAX_ARENAS; i++){
+        spin_lock(&arenas[i].lock);
+    }
+    spin_lock(&heap_lock);
+    spin_lock(&quarantine.lock);
+}
+
+/* Release the locks fork_prepare() took, in parent and child alike */
+static void fork_release(void){
+    spin_unlock(&quarantine.lock);
+    spin_unlock(&heap_lock);
+    for(int i = MAX_ARENAS - 1; i >= 0; i--){
+        spin_unlock(&arenas[i].lock);
+    }
+}
+
+static void fork_handlers_init(void){
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+/* Set up arenas and detect the NUMA topology.  The CSEMALLOC_NUMA_NODES
+ * environment variable overrides the node count with a fake topology,
+ * e.g. to exercise several arenas on a single node machine.
+ * CSEMALLOC_CACHE_ALIGN, CSEMALLOC_GUARD_RATE,
+ * CSEMALLOC_GUARD_QUARANTINE_MS and CSEMALLOC_LATENCY set the options
+ * of the same names.
+ * Running it twice is harmless, so concurrent first calls don't need a
+ * lock. */
+static int init(void){
+    for(int i = 0; i < MAX_ARENAS; i++){
+        arenas[i].index = i;
+    }
+    real_numa_nodes = detect_numa_nodes();
+    long nodes = real_numa_nodes;
+    const char *env = getenv("CSEMALLOC_NUMA_NODES");
+    if(env != NULL && atoi(env) > 0){
+        nodes = atoi(env);
+    }
+    set_numa_nodes(nodes);
+    env = getenv("CSEMALLOC_CACHE_ALIGN");
+    if(env != NULL){
+        cache_align = atoi(env);
+    }
+    env = getenv("CSEMALLOC_GUARD_RATE");
+    if(env != NULL && atoi(env) > 0){
+        guard_rate = atoi(env);
+    }
+    env = getenv("CSEMALLOC_GUARD_QUARANTINE_MS");
+    if(env != NULL){
+        guard_quarantine_ms = atoi(env);
+    }
+    env = getenv("CSEMALLOC_LATENCY");
+    if(env != NULL){
+        latency_enabled = atoi(env);
+    }
+    // numa_nodes is set, so malloc() in pthread_atfork() won't get here
+    pthread_once(&fork_once, fork_handlers_init);
+    return 0;
+}
+
+/* Return the NUMA node the calling thread runs on.  With a fake
+ * topology on a single node machine, CPUs are spread over the fake
+ * nodes instead. */
+static int current_node(){
+    unsigned int cpu = 0, node = 0;
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) != 0){
+        return 0;
+    }
+    if(real_numa_nodes < 2){
+        return cpu % numa_nodes;
+    }
+    return node;
+}
+
+/* Return the arena of the calling thread */
+static arena *current_arena(){
+    if(thread_pinned_node >= 0){
+        return &arenas[thread_pinned_node % numa_nodes];
+    }
+    if(thread_node_ttl-- <= 0){
+        thread_node = current_node();
+        thread_node_ttl = NODE_REFRESH;
+    }
+    return &arenas[thread_node % numa_nodes];
+}
+
+/* Prefer the node of arena a for the pages of [ptr, ptr + size), which
+ * must be page aligned and not yet touched.  Does nothing on single
+ * node machines or for arenas past the real nodes of a fake topology,
+ * and a failing mbind() just leaves first-touch placement. */
+static void bind_memory(void *ptr, size_t size, arena *a){
+    if(real_numa_nodes < 2 || a -> index >= real_numa_nodes){
+        return;
+    }
+    unsigned long nodemask = 1UL << a -> index;
+    STAT_ADD(mbind_calls, 1);
+    syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, &nodemask,
+            sizeof(nodemask) * 8, 0);
+}
+
+/* Return nonzero if page i of medium region r is in use */
+static inline int page_used(mediumRegion *r, size_t i){
+    return (r -> map[i / 64] >> (i % 64)) & 1;
+}
+
+/* Mark npages pages starting at page first of r as used or unused */
+static void mark_pages(mediumRegion *r, size_t first, size_t npages, int used){
+    for(size_t i = first; i < first + npages; i++){
+        if(used){
+            r -> map[i / 64] |= (uint64_t)1 << (i % 64);
+        }else{
+            r -> map[i / 64] &= ~((uint64_t)1 << (i % 64));
+        }
+    }
+}
+
+/* Find the smallest run of unused pages of r that holds npages pages.
+ * Returns the first page of the run (and its length in *run_len), or 0
+ * if there is none.  Page 0 holds the region itself, so it is never a
+ * valid result. */
+static size_t medium_best_fit(mediumRegion *r, size_t npages, size_t *run_len){
+    size_t best = 0, best_len = 0;
+    size_t i = 0;
+    while(i < MEDIUM_REGION_PAGES){
+        //skip words of used pages at once
+        if(i % 64 == 0 && r -> map[i / 64] == UINT64_MAX){
+            i += 64;
+            continue;
+        }
+        if(page_used(r, i)){
+            i++;
+            continue;
+        }
+        //measure unused run starting at page i
+        size_t start = i;
+        while(i < MEDIUM_REGION_PAGES && !page_used(r, i)){
+            //skip words of unused pages at once
+            if(i % 64 == 0 && r -> map[i / 64] == 0){
+                i += 64;
+            }else{
+                i++;
+            }
+        }
+        size_t len = i - start;
+        //keep the tightest run that fits
+        if(len >= npages && (best == 0 || len < best_len)){
+            best = start;
+            best_len = len;
+            //exact fit can't be beaten
+            if(len == npages) break;
+        }
+    }
+    *run_len = best_len;
+    return best;
+}
+
+/* Map a new medium region of arena a aligned to MEDIUM_REGION_SIZE, so
+ * that MEDIUM_REGION() finds it from any pointer into it.  The caller
+ * holds the arena lock. */
+static mediumRegion *medium_new_region(arena *a){
+    DEBUG_MESSAGE("\n\t\t...Map New Medium Region");
+    //over-map so that an aligned region fits, then trim both ends
+    size_t span = 2 * MEDIUM_REGION_SIZE - MEDIUM_PAGE;
+    char *p = map_pages(span);
+    if(p == NULL){
+        return NULL;
+    }
+    char *start = (char *)MEDIUM_REGION(p + MEDIUM_REGION_SIZE - 1);
+    size_t head = start - p;
+    size_t tail = span - head - MEDIUM_REGION_SIZE;
+    if(head > 0){
+        unmap_pages(p, head);
+    }
+    if(tail > 0){
+        unmap_pages(start + MEDIUM_REGION_SIZE, tail);
+    }
+    // bind before setting up the region touches its first page
+    bind_memory(start, MEDIUM_REGION_SIZE, a);
+    // set up region and push it to medium_regions of the arena
+    mediumRegion *r = (mediumRegion *)start;
+    memset(r -> map, 0, sizeof(r -> map));
+    mark_pages(r, 0, 1, 1);
+    r -> arena = a -> index;
+    r -> free_pages = MEDIUM_REGION_PAGES - 1;
+    r -> next = a -> medium_regions;
+    a -> medium_regions = r;
+    STAT_ADD(medium_regions, 1);
+    DEBUG_MESSAGE("\n\t\t\tMedium region at %p", r);
+    return r;
+}
+
+/* Allocate a run of asize bytes (a multiple of MEDIUM_PAGE) with best
+ * fit over the medium regions of arena a, mapping a new region if none
+ * fits. */
+static Header *medium_alloc(arena *a, size_t asize){
+    DEBUG_MESSAGE("\n\t\t---------Start Medium Alloc------------");
+    size_t npages = asize / MEDIUM_PAGE;
+    mediumRegion *r, *best_r = NULL;
+    size_t best = 0, best_len = 0;
+    spin_lock(&a -> lock);
+    //find best fit run over all regions
+    for(r = a -> medium_regions; r != NULL; r = r -> next){
+        if(r -> free_pages < npages) continue;
+        size_t len;
+        size_t first = medium_best_fit(r, npages, &len);
+        if(first != 0 && (best_r == NULL || len < best_len)){
+            best_r = r;
+            best = first;
+            best_len = len;
+            if(len == npages) break;
+        }
+    }
+    //if no region has room, map a new one
+    if(best_r == NULL){
+        if((best_r = medium_new_region(a)) == NULL){
+            spin_unlock(&a -> lock);
+            return NULL;
+        }
+        best = 1;
+    }
+    // take the run
+    mark_pages(best_r, best, npages, 1);
+    best_r -> free_pages -= npages;
+    spin_unlock(&a -> lock);
+    STAT_ADD(medium_allocs, 1);
+    Header *hp = (Header *)((char *)best_r + best * MEDIUM_PAGE);
+    PUT(hp, PACK(asize, MEDIUM_FLAG | 1));
+    DEBUG_MESSAGE("\n\t\t\t%ld pages at page %ld of region %p", npages, best, best_r);
+    DEBUG_MESSAGE("\n\t\t---------End Medium Alloc--------------");
+    return hp;
+}
+
+/* Return the run of hp to its region, in whichever arena owns it.
+ * Unused pages coalesce in the bitmap on their own; a region that
+ * becomes empty is unmapped unless it is the last one of its arena. */
+static void medium_free(Header *hp){
+    mediumRegion *r = MEDIUM_REGION(hp);
+    arena *a = &arenas[r -> arena];
+    size_t first = ((char *)hp - (char *)r) / MEDIUM_PAGE;
+    size_t npages = GET_SIZE(hp) / MEDIUM_PAGE;
+    spin_lock(&a -> lock);
+    mark_pages(r, first, npages, 0);
+    r -> free_pages += npages;
+    //if region is empty and not the only region
+    if(r -> free_pages == MEDIUM_REGION_PAGES - 1
+       && (r != a -> medium_regions || r -> next != NULL)){
+        DEBUG_MESSAGE("\n\t...Unmap Empty Medium Region %p", r);
+        //unlink region
+        mediumRegion **pp = &a -> medium_regions;
+        while(*pp != r){
+            pp = &(*pp) -> next;
+        }
+        *pp = r -> next;
+        spin_unlock(&a -> lock);
+        STAT_SUB(medium_regions, 1);
+        unmap_pages(r, MEDIUM_REGION_SIZE);
+        return;
+    }
+    spin_unlock(&a -> lock);
+}
 
+/* Resize run hp in place to asize bytes, growing into the unused pages
+ * that follow it, or giving back its trailing pages.  Returns nonzero
+ * on success. */
+static int medium_resize(Header *hp, size_t asize){
+    size_t size = GET_SIZE(hp);
+    if(asize == size){
+        return 1;
+    }
+    mediumRegion *r = MEDIUM_REGION(hp);
+    arena *a = &arenas[r -> arena];
+    size_t first = ((char *)hp - (char *)r) / MEDIUM_PAGE;
+    size_t have = size / MEDIUM_PAGE;
+    size_t need = asize / MEDIUM_PAGE;
+    //shrink: release trailing pages
+    if(asize < size){
+        spin_lock(&a -> lock);
+        mark_pages(r, first + need, have - need, 0);
+        r -> free_pages += have - need;
+        spin_unlock(&a -> lock);
+        PUT(hp, PACK(asize, MEDIUM_FLAG | 1));
+        return 1;
+    }
+    if(first + need > MEDIUM_REGION_PAGES){
+        return 0;
+    }
+    spin_lock(&a -> lock);
+    //check following pages are unused
+    for(size_t i = first + have; i < first + need; i++){
+        if(page_used(r, i)){
+            spin_unlock(&a -> lock);
+            return 0;
+        }
+    }
+    mark_pages(r, first + have, need - have, 1);
+    r -> free_pages -= need - have;
+    spin_unlock(&a -> lock);
+    PUT(hp, PACK(asize, MEDIUM_FLAG | 1));
+    return 1;
+}
 
 /*
  * You must also implement calloc().  It should create allocations
@@ -482,6 +1563,8 @@ void *calloc(size_t nmemb, size_t size) {
     return ptr;
 }
 
+static void *move_block(void *ptr, size_t capacity, size_t size, int flags);
+
 /*
  * You must also implement realloc().  It should create allocations
  * compatible with those created by malloc(), honoring the pool
@@ -496,30 +1579,65 @@ void *calloc(size_t nmemb, size_t size) {
  */
 void *realloc(void *ptr, size_t size) {
     DEBUG_MESSAGE("\n--------Start Realloc------------");
+    //realloc of NULL is malloc
+    if(ptr == NULL) return malloc(size);
+    //guarded allocations always move, so the guard page stays snug
+    if(GET_GUARD(HDRP(ptr))){
+        DEBUG_MESSAGE("\n...Move Guarded Allocation");
+        int flags = cache_align ? CSEMALLOC_CACHE_LINE : 0;
+        return move_block(ptr, guard_capacity(ptr), size, flags);
+    }
     //get block header of ptr
-    Header *hp = HDRP(ptr);
+    Header *hp = BLOCK_HDRP(ptr);
     //get block size
     size_t block_size = GET_SIZE(hp);
+    //get offset of ptr in block, and the bytes it holds from there
+    size_t offset = (char *)ptr - (char *)hp;
+    size_t capacity = block_size - offset;
     DEBUG_MESSAGE("\n...Check Extend Or Reduce Allocations");
     // block size is enough large than size return origin block
-    if(block_size <= CHUNK_SIZE && block_size - DSIZE > size){
+    if(block_size <= CHUNK_SIZE && capacity > size){
         DEBUG_MESSAGE("\n\tExtend(Reduce) Allocations");
         DEBUG_MESSAGE("\n------------End Realloc-----------\n");
         return ptr;
     } 
+    // medium run that stays medium may be resized in place
+    size_t bsize = size + offset - DSIZE;
+    if(GET_MEDIUM(hp) && bsize > CHUNK_SIZE - DSIZE && bsize <= MEDIUM_MAX
+       && medium_resize(hp, PAGE_RUN_SIZE(bsize))){
+        PUT(HDRP(ptr), GET(hp));
+        DEBUG_MESSAGE("\n\tResize Medium Run In Place");
+        DEBUG_MESSAGE("\n------------End Realloc-----------\n");
+        return ptr;
+    }
     //else
+    //move to new block, line-aligned again if ptr was
+    int flags = (cache_align || LINE_ALIGNED(ptr)) ? CSEMALLOC_CACHE_LINE : 0;
+    return move_block(ptr, capacity, size, flags);
+}
+
+/* Move block pointer ptr, holding capacity bytes, to a new allocation
+ * of size bytes made with flags, and free it */
+static void *move_block(void *ptr, size_t capacity, size_t size, int flags){
+    uint64_t start = latency_start();
     //malloc new block
     DEBUG_MESSAGE("\n...malloc new memory");
-    void *new_ptr = malloc(size);
-    // copy origin data to new data
+    void *new_ptr = allocate(size, flags);
+    if(new_ptr == NULL) return NULL;
+    // copy origin data to new data, no more than the new block holds
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n...Copy Data");
-    memcpy(new_ptr, ptr, block_size - DSIZE);
+    size_t copy_size = capacity;
+    if(copy_size > size){
+        copy_size = size;
+    }
+    memcpy(new_ptr, ptr, copy_size);
     // free origin block
     DEBUG_MESSAGE("\n...Free Original memory");
     free(ptr);
+    latency_record(LATENCY_REALLOC_COPY, start);
     // return new block
-    return new_ptr;    
+    return new_ptr;
 }
 
 /*
@@ -531,54 +1649,207 @@ void *realloc(void *ptr, size_t size) {
  */
 void free(void *ptr) {
     DEBUG_MESSAGE("\n---------Start Free---------------");
+    //freeing NULL does nothing
+    if(ptr == NULL) return;
+    // if block is guarded, its header is right before it
+    if(GET_GUARD(HDRP(ptr))){
+        DEBUG_MESSAGE("\n\t...Quarantine Guarded Allocation");
+        guard_free(ptr);
+        DEBUG_MESSAGE("\n----------End Free----------\n");
+        return;
+    }
     //get block header
-    Header* hp = HDRP(ptr);
+    Header* hp = BLOCK_HDRP(ptr);
     DEBUG_MESSAGE("\n\t**********Block Info*************");
     PRINT_BLOCK_INFO(hp, "\t");
     DEBUG_MESSAGE("\n\t*********************************");
     // get block size
     size_t size = GET_SIZE(hp);
-    // if block is large
-    if(size > CHUNK_SIZE - DSIZE){
+    // if block is a medium run
+    if(GET_MEDIUM(hp)){
+        DEBUG_MESSAGE("\n\t...Return Run To Medium Region");
+        uint64_t start = latency_start();
+        medium_free(hp);
+        latency_record(LATENCY_MEDIUM_FREE, start);
+        DEBUG_MESSAGE("\n----------End Free----------\n");
+        return;
+    }
+    // if block is large (pool blocks are at most CHUNK_SIZE)
+    if(size > CHUNK_SIZE){
         DEBUG_MESSAGE("\n\t...Using bulk_free()");
         // free using bulk_free and end function
-        bulk_free(hp, size);
+        uint64_t start = latency_start();
+        unmap_memory(hp, size);
+        latency_record(LATENCY_BULK_FREE, start);
         DEBUG_MESSAGE("\n----------End Free----------\n");
         return;
     }
-    // else
+    // keep small blocks this thread carved to it
+    if(size == CACHE_LINE / 2 && GET_SMALL_TAG(hp) != 0 && small_cache_push(hp)){
+        DEBUG_MESSAGE("\n\t...Keep In Thread Small Cache");
+        DEBUG_MESSAGE("\n----------End Free----------\n");
+        return;
+    }
+    pool_free(hp);
+    DEBUG_MESSAGE("\n------------End Free-------------\n");
+}
+
+/* Return pool block hp to the arena that owns it, whichever node this
+ * thread runs on */
+static void pool_free(Header *hp){
+    size_t size = GET_SIZE(hp);
+    arena *a = &arenas[GET_ARENA(hp)];
+    spin_lock(&a -> lock);
+    // a 32 byte block whose other half of the line is free too gives
+    // back the whole line, which small_alloc() can carve again
+    if(size == CACHE_LINE / 2){
+        Header *buddy = (Header *)((uintptr_t)hp ^ (CACHE_LINE / 2));
+        if(!GET_ALLOC(buddy) && GET_SIZE(buddy) == CACHE_LINE / 2){
+            DEBUG_MESSAGE("\n\t...Merge Cache Line Halves");
+            remove_free_block(a, buddy);
+            hp = (Header *)((uintptr_t)hp & ~(uintptr_t)(CACHE_LINE - 1));
+            size = CACHE_LINE;
+        }
+    }
     // set allocation flag as 0
     DEBUG_MESSAGE("\n");
     DEBUG_MESSAGE("\n\t...Set Allocation Flag as 0");
-    PUT(hp, PACK(size, 0));
+    PUT(hp, PACK(size, ARENA_BITS(a -> index)));
     // set explicit Metadata and add to last of explicit free lists
     DEBUG_MESSAGE("\n\t...Set Explicit Metadata");
     // get explicit metadata of block
     explicitMeta *exMeta = (explicitMeta *)BLKP(hp);
-    // if explicit_free_lists is null
-    if(explicit_free_lists == NULL){ // it means there was no free block
+    // if free_lists is null
+    if(a -> free_lists == NULL){ // it means there was no free block
         //set predecessor as itself
         exMeta -> pred = hp;
         // set successor as itself
         exMeta -> succ = hp;
-        // set explicit_free_lists as explicit metadata of block
-        explicit_free_lists = exMeta;
+        // set free_lists as explicit metadata of block
+        a -> free_lists = exMeta;
     }else{
         // set predecessor as origin last free block
-        exMeta -> pred = explicit_free_lists -> succ;
+        exMeta -> pred = a -> free_lists -> succ;
         // set successor of origin last free block as current block
-        explicit_free_lists -> succ = hp;
+        a -> free_lists -> succ = hp;
         // set successor of current block as itself
         exMeta -> succ = hp;
-        // set explicit_free_lists as explicit metadata of current block
-        explicit_free_lists = exMeta;
+        // set free_lists as explicit metadata of current block
+        a -> free_lists = exMeta;
     }
 
     DEBUG_MESSAGE("\n");
     #ifdef DEBUG
-        printFreeBlockList("\t");
+        printFreeBlockList(a, "\t");
     #endif
-    DEBUG_MESSAGE("\n------------End Free-------------\n");
-    return;
+    spin_unlock(&a -> lock);
 }
 
+/*
+ * Read the allocator counter called name into *value.  Known counters
+ * are sbrk_calls, mmap_calls, munmap_calls, medium_regions,
+ * medium_allocs, bulk_allocs, mbind_calls, guard_allocs and
+ * guard_frees.
+ *
+ * With the latency option on, the latency of the paths free_list,
+ * split, extend_heap, bulk_alloc, bulk_free, realloc_copy,
+ * medium_alloc and medium_free is
+ * recorded in log-linear histograms, in TSC cycles on x86 and in
+ * nanoseconds elsewhere, and read as:
+ *   latency.<path>.count: operations recorded on path
+ *   latency.<path>.<i>:   operations in bucket i
+ *   latency.<path>.p50, .p99, .p999: smallest latency of the bucket
+ *                holding that percentile
+ *   latency.buckets:     number of buckets
+ *   latency.bucket.<i>:  smallest latency of bucket i
+ * Returns 0 on success, or -1 if there is no such counter.
+ */
+int csemalloc_stat(const char *name, size_t *value) {
+    const struct { const char *name; size_t *value; } table[] = {
+        { "sbrk_calls", &stats.sbrk_calls },
+        { "mmap_calls", &stats.mmap_calls },
+        { "munmap_calls", &stats.munmap_calls },
+        { "medium_regions", &stats.medium_regions },
+        { "medium_allocs", &stats.medium_allocs },
+        { "bulk_allocs", &stats.bulk_allocs },
+        { "mbind_calls", &stats.mbind_calls },
+        { "guard_allocs", &stats.guard_allocs },
+        { "guard_frees", &stats.guard_frees },
+    };
+    if(strncmp(name, "latency.", 8) == 0){
+        return latency_stat(name + 8, value);
+    }
+    for(size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++){
+        if(strcmp(name, table[i].name) == 0){
+            *value = *table[i].value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Set the allocator option called name to value.  Known options are
+ *   medium:      nonzero serves allocations up to MEDIUM_MAX bytes from
+ *                medium regions, zero sends them to bulk_alloc() instead
+ *   numa_nodes:  spread arenas over value nodes, faking a topology if
+ *                it differs from the real one
+ *   thread_node: allocate from the arena of node value in the calling
+ *                thread, or follow the scheduler again if value < 0
+ *   cache_align: nonzero makes malloc() behave as if passed
+ *                CSEMALLOC_CACHE_LINE
+ *   guard_rate:  nonzero places one in value allocations before a
+ *                guard page (1 guards all of them), zero none
+ *   guard_quarantine_ms: milliseconds freed guarded allocations stay
+ *                protected before they are unmapped
+ *   latency:     nonzero records the latency of allocator paths, see
+ *                csemalloc_stat()
+ * Returns 0 on success, or -1 if there is no such option.
+ */
+int csemalloc_set_option(const char *name, long value) {
+    if(strcmp(name, "medium") == 0){
+        medium_enabled = value;
+        return 0;
+    }
+    if(strcmp(name, "numa_nodes") == 0){
+        //detect the topology first, so it can't override value later
+        if(numa_nodes == 0) init();
+        set_numa_nodes(value);
+        return 0;
+    }
+    if(strcmp(name, "thread_node") == 0){
+        thread_pinned_node = value < 0 ? -1 : value;
+        return 0;
+    }
+    if(strcmp(name, "cache_align") == 0){
+        cache_align = value;
+        return 0;
+    }
+    if(strcmp(name, "guard_rate") == 0){
+        guard_rate = value < 0 ? 0 : value;
+        //reseed the calling thread for the new rate
+        thread_guard_countdown = 0;
+        return 0;
+    }
+    if(strcmp(name, "guard_quarantine_ms") == 0){
+        guard_quarantine_ms = value;
+        return 0;
+    }
+    if(strcmp(name, "latency") == 0){
+        latency_enabled = value;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Allocate size bytes like malloc(), with flags.  CSEMALLOC_CACHE_LINE
+ * (0x1) returns a pointer aligned to a 64 byte cache line if size is
+ * above 24 bytes, and otherwise a block whose cache line no other
+ * thread allocated from.  The result may be passed to free() and
+ * realloc(), which keeps it line-aligned.
+ */
+void *csemalloc_malloc_flags(size_t size, int flags) {
+    if(numa_nodes == 0) init();
+    return allocate(size, flags);
+}
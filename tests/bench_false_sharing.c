@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+int csemalloc_set_option(const char *name, long value);
+
+#define NTHREADS 4
+#define INCREMENTS 20000000
+#define CACHE_LINE 64
+#define WARM_BLOCKS 64
+
+static volatile long *counters[NTHREADS];
+static size_t counter_size;
+static pthread_barrier_t warm_barrier;
+static pthread_barrier_t lockstep;
+
+/* Once the heap is warm, allocate this thread's counter in lockstep
+ * with the other threads, then increment it. */
+static void *worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    pthread_barrier_wait(&warm_barrier);
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        if (i == id)
+        {
+            counters[id] = malloc(counter_size);
+            *counters[id] = 0;
+        }
+        pthread_barrier_wait(&lockstep);
+    }
+    for (long i = 0; i < INCREMENTS; i++)
+    {
+        (*counters[id])++;
+    }
+    return NULL;
+}
+
+/* Count cache lines holding bytes of more than one thread's counter. */
+static int shared_lines(void)
+{
+    int shared = 0;
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        uintptr_t first = (uintptr_t)counters[i] / CACHE_LINE;
+        uintptr_t last = ((uintptr_t)counters[i] + counter_size - 1) / CACHE_LINE;
+        for (int j = i + 1; j < NTHREADS; j++)
+        {
+            uintptr_t jfirst = (uintptr_t)counters[j] / CACHE_LINE;
+            uintptr_t jlast = ((uintptr_t)counters[j] + counter_size - 1) / CACHE_LINE;
+            shared += first <= jlast && jfirst <= last;
+        }
+    }
+    return shared;
+}
+
+/* Each thread increments a counter of size bytes it allocated itself,
+ * from a heap warmed up by freeing neighbouring blocks once all threads
+ * started. */
+static void run(const char *label, long align, size_t size)
+{
+    struct timespec start, end;
+    pthread_t threads[NTHREADS];
+    void *warm[WARM_BLOCKS];
+
+    csemalloc_set_option("cache_align", align);
+    counter_size = size;
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < WARM_BLOCKS; i++)
+    {
+        warm[i] = malloc(size);
+    }
+    for (int i = 0; i < WARM_BLOCKS; i++)
+    {
+        free(warm[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_barrier_wait(&warm_barrier);
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec)
+                  + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-8s %4zu B counters  %12.0f increments/s  shared lines %d\n",
+           label, size, NTHREADS * (double)INCREMENTS / secs, shared_lines());
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        free((void *)counters[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    printf("bench_false_sharing: %d threads, %d increments each\n",
+           NTHREADS, INCREMENTS);
+    pthread_barrier_init(&warm_barrier, NULL, NTHREADS + 1);
+    pthread_barrier_init(&lockstep, NULL, NTHREADS);
+    run("default", 0, sizeof(long));
+    run("aligned", 1, sizeof(long));
+    run("default", 0, 64);
+    run("aligned", 1, 64);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+int csemalloc_stat(const char *name, size_t *value);
+int csemalloc_set_option(const char *name, long value);
+
+#define SLOTS 256
+#define OPS 200000
+#define WARM_OPS (OPS / 4)
+#define NSIZES 4
+
+/* Each slot always holds the same size, so the pool reuses the block
+ * freed from it and the unguarded baseline stays steady. */
+static const size_t sizes[NSIZES] = { 24, 100, 400, 1000 };
+static void *slots[SLOTS];
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static size_t stat(const char *name)
+{
+    size_t value = 0;
+    csemalloc_stat(name, &value);
+    return value;
+}
+
+/* Free and reallocate ops random slots */
+static void replace(int ops)
+{
+    for (int op = 0; op < ops; op++)
+    {
+        int i = next_random() % SLOTS;
+        size_t size = sizes[i % NSIZES];
+        free(slots[i]);
+        char *p = slots[i] = malloc(size);
+        p[0] = p[size - 1] = 1;
+    }
+}
+
+/* Replace random slots, guarding one in rate allocations, and return
+ * the nanoseconds per free and malloc pair.  Untimed warm up ops first
+ * replace the blocks allocated at the previous rate. */
+static double run(long rate, size_t *guarded, size_t *mmaps, size_t *munmaps)
+{
+    struct timespec start, end;
+
+    csemalloc_set_option("guard_rate", rate);
+    replace(WARM_OPS);
+    *guarded = stat("guard_allocs");
+    *mmaps = stat("mmap_calls");
+    *munmaps = stat("munmap_calls");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replace(OPS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *guarded = stat("guard_allocs") - *guarded;
+    *mmaps = stat("mmap_calls") - *mmaps;
+    *munmaps = stat("munmap_calls") - *munmaps;
+    return ((end.tv_sec - start.tv_sec) * 1e9
+            + (end.tv_nsec - start.tv_nsec)) / OPS;
+}
+
+/* Report the cost of guarding at several rates against an unguarded
+ * baseline measured before and after them, and what each guarded
+ * allocation adds on its own. */
+int main(int argc, char *argv[])
+{
+    long rates[] = { 0, 1000, 100, 10, 1, 0 };
+    size_t guarded, mmaps, munmaps;
+    double base = 0;
+
+    printf("bench_guard: %d ops over %d slots of %zu-%zu bytes\n",
+           OPS, SLOTS, sizes[0], sizes[NSIZES - 1]);
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        double ns = run(rates[r], &guarded, &mmaps, &munmaps);
+        if (r == 0)
+        {
+            base = ns;
+        }
+        printf("rate %-6ld %8.0f ns/op  guarded %7zu  mmap %7zu  munmap %7zu",
+               rates[r], ns, guarded, mmaps, munmaps);
+        if (guarded > 0)
+        {
+            printf("  %8.0f ns/guarded op", (ns - base) * OPS / guarded);
+        }
+        printf("\n");
+    }
+    for (int i = 0; i < SLOTS; i++)
+    {
+        free(slots[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int csemalloc_stat(const char *name, size_t *value);
+int csemalloc_set_option(const char *name, long value);
+
+#define SLOTS 512
+#define OPS 100000
+#define MIN_SIZE (4 << 10)
+#define MAX_SIZE (256 << 10)
+#define PAGE 4096
+
+static void *slots[SLOTS];
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static size_t stat(const char *name)
+{
+    size_t value = 0;
+    csemalloc_stat(name, &value);
+    return value;
+}
+
+/* Count the mappings of this process, one per line of /proc/self/maps. */
+static int count_vmas(void)
+{
+    char buf[4096];
+    ssize_t n;
+    int lines = 0;
+    int fd = open("/proc/self/maps", O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < n; i++)
+        {
+            lines += buf[i] == '\n';
+        }
+    }
+    close(fd);
+    return lines;
+}
+
+/* Replace random slots with allocations of 4-256 KiB, touching every
+ * page, and report syscalls, peak mappings and throughput. */
+static void run(const char *label, long medium)
+{
+    struct timespec start, end;
+    int peak_vmas = 0;
+
+    csemalloc_set_option("medium", medium);
+    size_t mmaps = stat("mmap_calls");
+    size_t munmaps = stat("munmap_calls");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int op = 0; op < OPS; op++)
+    {
+        int i = next_random() % SLOTS;
+        size_t size = MIN_SIZE + next_random() % (MAX_SIZE - MIN_SIZE);
+        free(slots[i]);
+        char *p = slots[i] = malloc(size);
+        for (size_t off = 0; off < size; off += PAGE)
+        {
+            p[off] = 1;
+        }
+        if (op % 10000 == 0)
+        {
+            int vmas = count_vmas();
+            peak_vmas = vmas > peak_vmas ? vmas : peak_vmas;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < SLOTS; i++)
+    {
+        free(slots[i]);
+        slots[i] = NULL;
+    }
+
+    double secs = (end.tv_sec - start.tv_sec)
+                  + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-8s %12.0f ops/s  mmap %8zu  munmap %8zu  peak VMAs %6d\n",
+           label, OPS / secs, stat("mmap_calls") - mmaps,
+           stat("munmap_calls") - munmaps, peak_vmas);
+}
+
+int main(int argc, char *argv[])
+{
+    printf("bench_medium: %d ops over %d slots, %d-%d KiB\n",
+           OPS, SLOTS, MIN_SIZE >> 10, MAX_SIZE >> 10);
+    run("bulk", 0);
+    run("medium", 1);
+    return 0;
+}
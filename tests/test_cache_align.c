@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+int csemalloc_set_option(const char *name, long value);
+int csemalloc_stat(const char *name, size_t *value);
+void *csemalloc_malloc_flags(size_t size, int flags);
+
+#define CSEMALLOC_CACHE_LINE 0x1
+#define CACHE_LINE 64
+#define NSIZES 9
+#define NTHREADS 2
+#define NSMALL 16
+#define SMALL_SIZE 8
+#define GROW_SIZE 5000
+#define BATCH 128
+#define ROUNDS 384
+
+static const size_t sizes[NSIZES] = {
+    25, 40, 64, 100, 1000, 4000, 6000, 300000, 2 << 20
+};
+static uintptr_t small[NTHREADS][NSMALL];
+static void *batch[BATCH];
+static pthread_barrier_t warm_barrier;
+static pthread_barrier_t lockstep;
+
+/* Once the heap is warm, allocate small objects in lockstep with the
+ * other thread, so that without segregation they would be carved from
+ * the same lines. */
+static void *worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    pthread_barrier_wait(&warm_barrier);
+    for (int i = 0; i < NSMALL; i++)
+    {
+        pthread_barrier_wait(&lockstep);
+        small[id][i] = (uintptr_t)malloc(SMALL_SIZE);
+    }
+    return NULL;
+}
+
+/* Free a small block of the main thread, then allocate small blocks,
+ * which must not reuse it, as its line partner may still be in use. */
+static void *foreign_freer(void *arg)
+{
+    uintptr_t foreign = (uintptr_t)arg;
+    free((void *)foreign);
+    for (int i = 0; i < NSMALL; i++)
+    {
+        uintptr_t p = (uintptr_t)malloc(SMALL_SIZE);
+        if (p / CACHE_LINE == foreign / CACHE_LINE)
+        {
+            return (void *)p;
+        }
+    }
+    return NULL;
+}
+
+/* Free the whole batch allocated by the main thread. */
+static void *batch_freer(void *arg)
+{
+    for (int i = 0; i < BATCH; i++)
+    {
+        free(batch[i]);
+    }
+    return NULL;
+}
+
+/* Allocate a batch of small blocks and free it from another thread,
+ * then allocate one and free it here, overflowing the thread's cache.
+ * Either way the halves reach the pool and must rebuild their lines. */
+static void churn_small(void)
+{
+    pthread_t freer;
+
+    for (int i = 0; i < BATCH; i++)
+    {
+        batch[i] = malloc(SMALL_SIZE);
+    }
+    pthread_create(&freer, NULL, batch_freer, NULL);
+    pthread_join(freer, NULL);
+    for (int i = 0; i < BATCH; i++)
+    {
+        batch[i] = malloc(SMALL_SIZE);
+    }
+    batch_freer(NULL);
+}
+
+/* This test checks that the cache_align option returns line-aligned
+ * blocks for every size class from 64 bytes up, that realloc() keeps
+ * them aligned, that small objects of different threads never share a
+ * cache line, even when one frees the other's, that huge sizes fail, and
+ * that the per-call flag works on its own. */
+int main(int argc, char *argv[])
+{
+    void *ptrs[NSIZES];
+
+    csemalloc_set_option("cache_align", 1);
+    for (int i = 0; i < NSIZES; i++)
+    {
+        ptrs[i] = malloc(sizes[i]);
+        if ((uintptr_t)ptrs[i] % CACHE_LINE != 0)
+        {
+            fprintf(stderr, "\n%zu byte block %p not line-aligned",
+                    sizes[i], ptrs[i]);
+            return 1;
+        }
+        memset(ptrs[i], i, sizes[i]);
+    }
+
+    /* Growing keeps the data and the alignment. */
+    char *grown = realloc(ptrs[1], GROW_SIZE);
+    if ((uintptr_t)grown % CACHE_LINE != 0)
+    {
+        fprintf(stderr, "\nrealloc() lost line alignment");
+        return 1;
+    }
+    for (size_t j = 0; j < sizes[1]; j++)
+    {
+        if (grown[j] != 1)
+        {
+            fprintf(stderr, "\nrealloc() lost data at %zu", j);
+            return 1;
+        }
+    }
+    ptrs[1] = grown;
+    for (int i = 0; i < NSIZES; i++)
+    {
+        free(ptrs[i]);
+    }
+
+    pthread_t threads[NTHREADS];
+    pthread_barrier_init(&warm_barrier, NULL, NTHREADS + 1);
+    pthread_barrier_init(&lockstep, NULL, NTHREADS);
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i);
+    }
+    /* Free a run of neighbouring small blocks for the threads to reuse. */
+    void *warm[NTHREADS * NSMALL];
+    for (int i = 0; i < NTHREADS * NSMALL; i++)
+    {
+        warm[i] = malloc(SMALL_SIZE);
+    }
+    for (int i = 0; i < NTHREADS * NSMALL; i++)
+    {
+        free(warm[i]);
+    }
+    pthread_barrier_wait(&warm_barrier);
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < NSMALL; i++)
+    {
+        for (int j = 0; j < NSMALL; j++)
+        {
+            if (small[0][i] / CACHE_LINE == small[1][j] / CACHE_LINE)
+            {
+                fprintf(stderr, "\nsmall blocks %lx and %lx share a line",
+                        small[0][i], small[1][j]);
+                return 1;
+            }
+        }
+    }
+
+    /* A small block freed by another thread is not cached there. */
+    pthread_t freer;
+    void *reused;
+    pthread_create(&freer, NULL, foreign_freer, malloc(SMALL_SIZE));
+    pthread_join(freer, &reused);
+    if (reused != NULL)
+    {
+        fprintf(stderr, "\nsmall block %p reused by the thread that freed it",
+                reused);
+        return 1;
+    }
+
+    /* Small blocks freed to the pool are reused, so once warm the heap
+     * stops growing however long the churn goes on. */
+    size_t before, after;
+    churn_small();
+    csemalloc_stat("sbrk_calls", &before);
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        churn_small();
+    }
+    csemalloc_stat("sbrk_calls", &after);
+    if (after != before)
+    {
+        fprintf(stderr, "\nsmall churn grew the heap from %zu to %zu slabs",
+                before, after);
+        return 1;
+    }
+
+    /* Sizes that would wrap around fail; volatile keeps the compiler
+     * from rejecting them. */
+    volatile size_t huge = SIZE_MAX;
+    if (malloc(huge) != NULL || malloc(huge - 10) != NULL)
+    {
+        fprintf(stderr, "\nmalloc of SIZE_MAX bytes succeeded");
+        return 1;
+    }
+
+    /* The per-call flag aligns without the global option. */
+    csemalloc_set_option("cache_align", 0);
+    void *flagged = csemalloc_malloc_flags(100, CSEMALLOC_CACHE_LINE);
+    void *plain = malloc(100);
+    if ((uintptr_t)flagged % CACHE_LINE != 0
+        || (uintptr_t)plain % CACHE_LINE == 0)
+    {
+        fprintf(stderr, "\nflagged: %p, plain: %p", flagged, plain);
+        return 1;
+    }
+    free(flagged);
+    free(plain);
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+int csemalloc_stat(const char *name, size_t *value);
+int csemalloc_set_option(const char *name, long value);
+
+#define NALLOCS 64
+#define NTHREADS 16
+#define RARE_RATE (1L << 30)
+
+static size_t stat(const char *name)
+{
+    size_t value = 0;
+    csemalloc_stat(name, &value);
+    return value;
+}
+
+/* Run fn in a child and return whether it died of SIGSEGV. */
+static int segfaults(void (*fn)(void))
+{
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        fn();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV;
+}
+
+static void overrun(void)
+{
+    /* An aligned size leaves no slack before the guard page. */
+    volatile char *p = malloc(128);
+    p[128] = 1;
+}
+
+static void use_after_free(void)
+{
+    /* Keep the address as an integer so the compiler lets us use it. */
+    uintptr_t p = (uintptr_t)malloc(100);
+    free((void *)p);
+    *(volatile char *)p = 1;
+}
+
+static void *first_alloc(void *arg)
+{
+    free(malloc(100));
+    return NULL;
+}
+
+/* This test checks that guarded allocations fault on overruns and on
+ * use after free, still behave as ordinary allocations otherwise, and
+ * that sampling guards the requested share of allocations without
+ * favouring the first allocations of new threads. */
+int main(int argc, char *argv[])
+{
+    void *ptrs[NALLOCS];
+
+    csemalloc_set_option("guard_rate", 1);
+    if (!segfaults(overrun))
+    {
+        fprintf(stderr, "\noverrun of a guarded allocation did not fault");
+        return 1;
+    }
+    if (!segfaults(use_after_free))
+    {
+        fprintf(stderr, "\nuse of a freed guarded allocation did not fault");
+        return 1;
+    }
+
+    /* Guarded allocations keep their contents through realloc. */
+    size_t guarded = stat("guard_allocs");
+    char *p = malloc(10);
+    memcpy(p, "guarded!!", 10);
+    p = realloc(p, 5000);
+    if (strcmp(p, "guarded!!") != 0)
+    {
+        fprintf(stderr, "\nrealloc lost the contents of a guarded allocation");
+        return 1;
+    }
+    p = realloc(p, 3);
+    if (memcmp(p, "gua", 3) != 0)
+    {
+        fprintf(stderr, "\nshrinking realloc lost the contents");
+        return 1;
+    }
+    free(p);
+    int *zeros = calloc(1000, sizeof(int));
+    for (int i = 0; i < 1000; i++)
+    {
+        if (zeros[i] != 0)
+        {
+            fprintf(stderr, "\ncalloc of a guarded allocation is not zeroed");
+            return 1;
+        }
+    }
+    free(zeros);
+    if (stat("guard_allocs") - guarded != 4)
+    {
+        fprintf(stderr, "\nguard_rate 1 did not guard every allocation");
+        return 1;
+    }
+
+    /* A sampled rate guards one in that many allocations. */
+    csemalloc_set_option("guard_rate", 4);
+    guarded = stat("guard_allocs");
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        ptrs[i] = malloc(i + 1);
+        memset(ptrs[i], i, i + 1);
+    }
+    if (stat("guard_allocs") - guarded != NALLOCS / 4)
+    {
+        fprintf(stderr, "\nguard_rate 4 guarded %zu of %d allocations",
+                stat("guard_allocs") - guarded, NALLOCS);
+        return 1;
+    }
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        for (int j = 0; j <= i; j++)
+        {
+            if (((unsigned char *)ptrs[i])[j] != i)
+            {
+                fprintf(stderr, "\nallocation %d overlaps another", i);
+                return 1;
+            }
+        }
+    }
+    size_t frees = stat("guard_frees");
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        free(ptrs[i]);
+    }
+    if (stat("guard_frees") - frees != NALLOCS / 4)
+    {
+        fprintf(stderr, "\nguarded frees were not quarantined");
+        return 1;
+    }
+
+    /* Sizes around page multiples, for both alignments, keep their
+     * header in the first page and survive realloc and free. */
+    csemalloc_set_option("guard_rate", 1);
+    for (long align = 0; align <= 1; align++)
+    {
+        csemalloc_set_option("cache_align", align);
+        for (size_t page = 4096; page <= 3 * 4096; page += 4096)
+        {
+            for (size_t size = page - 128; size <= page + 16; size++)
+            {
+                unsigned char *q = malloc(size);
+                memset(q, 0xa5, size);
+                q = realloc(q, size + 1);
+                for (size_t j = 0; j < size; j++)
+                {
+                    if (q[j] != 0xa5)
+                    {
+                        fprintf(stderr, "\nrealloc of %zu guarded bytes lost byte %zu",
+                                size, j);
+                        return 1;
+                    }
+                }
+                free(q);
+            }
+        }
+    }
+    csemalloc_set_option("cache_align", 0);
+
+    /* Sizes that would wrap around fail; volatile keeps the compiler
+     * from rejecting them. */
+    volatile size_t huge = SIZE_MAX;
+    if (malloc(huge) != NULL || malloc(huge - 10) != NULL)
+    {
+        fprintf(stderr, "\nguarded malloc of SIZE_MAX bytes succeeded");
+        return 1;
+    }
+
+    /* The first allocation of a new thread is not always guarded. */
+    csemalloc_set_option("guard_rate", RARE_RATE);
+    guarded = stat("guard_allocs");
+    pthread_t threads[NTHREADS];
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, first_alloc, NULL);
+    }
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    if (stat("guard_allocs") != guarded)
+    {
+        fprintf(stderr, "\nfirst allocations of new threads were guarded");
+        return 1;
+    }
+
+    /* Switching guarding off leaves allocations unguarded. */
+    csemalloc_set_option("guard_rate", 0);
+    guarded = stat("guard_allocs");
+    free(malloc(100));
+    if (stat("guard_allocs") != guarded)
+    {
+        fprintf(stderr, "\nguard_rate 0 still guards allocations");
+        return 1;
+    }
+
+    return 0;
+}
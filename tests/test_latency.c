@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+int csemalloc_stat(const char *name, size_t *value);
+int csemalloc_set_option(const char *name, long value);
+
+#define SMALL_SIZE 100
+#define MEDIUM_SIZE (16 << 10)
+#define HUGE_SIZE (2 << 20)
+#define NTHREADS 4
+#define THREAD_ALLOCS 100
+
+static const char *paths[] = {
+    "free_list", "split", "extend_heap", "bulk_alloc", "bulk_free",
+    "realloc_copy", "medium_alloc", "medium_free"
+};
+#define NPATHS (sizeof(paths) / sizeof(paths[0]))
+
+static size_t stat(const char *name)
+{
+    size_t value = 0;
+    if (csemalloc_stat(name, &value) != 0)
+    {
+        fprintf(stderr, "\nno counter %s", name);
+        exit(1);
+    }
+    return value;
+}
+
+static size_t path_stat(const char *path, const char *field)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "latency.%s.%s", path, field);
+    return stat(name);
+}
+
+static size_t total_count(void)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < NPATHS; i++)
+    {
+        total += path_stat(paths[i], "count");
+    }
+    return total;
+}
+
+/* Record latency in a thread of its own, returning the mmap() calls
+ * that took beyond the one of its allocation. */
+static void *mapper(void *arg)
+{
+    size_t mmaps = stat("mmap_calls");
+    free(malloc(HUGE_SIZE));
+    return (void *)(stat("mmap_calls") - mmaps - 1);
+}
+
+static void *worker(void *arg)
+{
+    for (int i = 0; i < THREAD_ALLOCS; i++)
+    {
+        free(malloc(SMALL_SIZE));
+    }
+    return NULL;
+}
+
+/* This test checks that every instrumented path records its latency
+ * when the latency option is on, that the histograms add up, that
+ * mapping them doesn't show in mmap_calls, and that the counts of
+ * exited threads are kept. */
+int main(int argc, char *argv[])
+{
+    /* Nothing is recorded while the option is off. */
+    free(malloc(SMALL_SIZE));
+    if (total_count() != 0)
+    {
+        fprintf(stderr, "\nlatency recorded while off");
+        return 1;
+    }
+
+    csemalloc_set_option("latency", 1);
+    csemalloc_set_option("medium", 0);
+
+    /* Take more than a chunk, so the heap is extended. */
+    void *blocks[64];
+    int n = 0;
+    while (n < 64)
+    {
+        blocks[n++] = malloc(SMALL_SIZE);
+    }
+    /* A freed block of the right size is reused as is. */
+    free(blocks[--n]);
+    blocks[n++] = malloc(SMALL_SIZE);
+    /* A small allocation splits a larger free block. */
+    blocks[n++] = malloc(16);
+    /* Huge allocations are mapped and unmapped. */
+    free(malloc(HUGE_SIZE));
+    /* Medium allocations are carved from regions. */
+    csemalloc_set_option("medium", 1);
+    free(malloc(MEDIUM_SIZE));
+    /* Growing a block past its size copies it. */
+    blocks[0] = realloc(blocks[0], 2 * SMALL_SIZE);
+    while (n > 0)
+    {
+        free(blocks[--n]);
+    }
+
+    for (size_t i = 0; i < NPATHS; i++)
+    {
+        size_t count = path_stat(paths[i], "count");
+        if (count == 0)
+        {
+            fprintf(stderr, "\nno latency recorded on %s", paths[i]);
+            return 1;
+        }
+        size_t sum = 0;
+        for (size_t b = 0; b < stat("latency.buckets"); b++)
+        {
+            char bucket[32];
+            snprintf(bucket, sizeof(bucket), "%zu", b);
+            sum += path_stat(paths[i], bucket);
+        }
+        if (sum != count)
+        {
+            fprintf(stderr, "\n%s buckets hold %zu of %zu", paths[i], sum, count);
+            return 1;
+        }
+        if (path_stat(paths[i], "p50") > path_stat(paths[i], "p999"))
+        {
+            fprintf(stderr, "\n%s p50 above p999", paths[i]);
+            return 1;
+        }
+    }
+
+    /* Bucket bounds are increasing. */
+    size_t buckets = stat("latency.buckets");
+    for (size_t b = 1; b < buckets; b++)
+    {
+        char name[64], prev[64];
+        snprintf(name, sizeof(name), "latency.bucket.%zu", b);
+        snprintf(prev, sizeof(prev), "latency.bucket.%zu", b - 1);
+        if (stat(name) <= stat(prev))
+        {
+            fprintf(stderr, "\nbucket %zu does not start above bucket %zu", b, b - 1);
+            return 1;
+        }
+    }
+    size_t value;
+    if (csemalloc_stat("latency.split.oops", &value) == 0
+        || csemalloc_stat("latency.nothing.count", &value) == 0)
+    {
+        fprintf(stderr, "\nunknown latency counters were read");
+        return 1;
+    }
+
+    /* The histograms of new threads are not counted as mmap() calls. */
+    pthread_t thread;
+    void *extra;
+    pthread_create(&thread, NULL, mapper, NULL);
+    pthread_join(thread, &extra);
+    if (extra != NULL)
+    {
+        fprintf(stderr, "\nlatency histograms counted in mmap_calls");
+        return 1;
+    }
+
+    /* Threads that exited still count. */
+    size_t before = total_count();
+    for (int round = 0; round < 2; round++)
+    {
+        pthread_t threads[NTHREADS];
+        for (int i = 0; i < NTHREADS; i++)
+        {
+            pthread_create(&threads[i], NULL, worker, NULL);
+        }
+        for (int i = 0; i < NTHREADS; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    if (total_count() - before < 2 * NTHREADS * THREAD_ALLOCS)
+    {
+        fprintf(stderr, "\nthread latencies were lost");
+        return 1;
+    }
+
+    return 0;
+}
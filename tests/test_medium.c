@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+int csemalloc_stat(const char *name, size_t *value);
+
+#define MEDIUM_SIZE (5 << 10)
+#define NALLOCS 64
+#define LARGE_MEDIUM_SIZE (NALLOCS * MEDIUM_SIZE)
+#define HUGE_SIZE (2 << 20)
+#define MEDIUM_MAX (1 << 20)
+#define SHRUNK_SIZE (8 << 10)
+
+static size_t stat(const char *name)
+{
+    size_t value = 0;
+    csemalloc_stat(name, &value);
+    return value;
+}
+
+/* This test checks that medium allocations are carved out of a shared
+ * medium region rather than mapped one by one, that freed runs
+ * coalesce, that huge allocations still use the bulk allocator, and
+ * that realloc() grows and shrinks runs in place. */
+int main(int argc, char *argv[])
+{
+    void *ptrs[NALLOCS];
+
+    /* Prime the medium region. */
+    void *first = malloc(MEDIUM_SIZE);
+    size_t mmaps = stat("mmap_calls");
+
+    /* Many medium allocations must not map any more memory. */
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        ptrs[i] = malloc(MEDIUM_SIZE);
+        memset(ptrs[i], i, MEDIUM_SIZE);
+    }
+    if (stat("mmap_calls") != mmaps)
+    {
+        fprintf(stderr, "\nmedium allocations called mmap()");
+        return 1;
+    }
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        for (int j = 0; j < MEDIUM_SIZE; j++)
+        {
+            if (((unsigned char *)ptrs[i])[j] != i)
+            {
+                fprintf(stderr, "\nmedium allocation %d overlaps another", i);
+                return 1;
+            }
+        }
+    }
+
+    /* Freed runs must coalesce into one run large enough for all of
+     * them together. */
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        free(ptrs[i]);
+    }
+    void *large = malloc(LARGE_MEDIUM_SIZE);
+    if (large != ptrs[0] || stat("mmap_calls") != mmaps)
+    {
+        fprintf(stderr, "\nfreed medium runs did not coalesce");
+        fprintf(stderr, "\nlarge: %p, ptrs[0]: %p", large, ptrs[0]);
+        return 1;
+    }
+
+    /* Growing into the free pages that follow must not move the run. */
+    memset(large, 0x5a, LARGE_MEDIUM_SIZE);
+    void *grown = realloc(large, 2 * LARGE_MEDIUM_SIZE);
+    if (grown != large)
+    {
+        fprintf(stderr, "\nrealloc() did not grow medium run in place");
+        return 1;
+    }
+    for (int j = 0; j < LARGE_MEDIUM_SIZE; j++)
+    {
+        if (((unsigned char *)grown)[j] != 0x5a)
+        {
+            fprintf(stderr, "\nrealloc() lost medium data at %d", j);
+            return 1;
+        }
+    }
+
+    /* Huge allocations still go to the bulk allocator. */
+    size_t bulk = stat("bulk_allocs");
+    void *huge = malloc(HUGE_SIZE);
+    if (stat("bulk_allocs") != bulk + 1)
+    {
+        fprintf(stderr, "\nhuge allocation did not use bulk_alloc()");
+        return 1;
+    }
+    free(huge);
+    free(grown);
+    free(first);
+
+    /* Shrinking in place gives the trailing pages back, so three more
+     * runs of MEDIUM_MAX fit next to the shrunk one in one region. */
+    size_t regions = stat("medium_regions");
+    char *shrunk = malloc(MEDIUM_MAX);
+    memset(shrunk, 0x3c, MEDIUM_MAX);
+    uintptr_t before = (uintptr_t)shrunk;
+    shrunk = realloc(shrunk, SHRUNK_SIZE);
+    if ((uintptr_t)shrunk != before)
+    {
+        fprintf(stderr, "\nrealloc() did not shrink medium run in place");
+        return 1;
+    }
+    for (int j = 0; j < SHRUNK_SIZE; j++)
+    {
+        if ((unsigned char)shrunk[j] != 0x3c)
+        {
+            fprintf(stderr, "\nshrinking realloc() lost medium data at %d", j);
+            return 1;
+        }
+    }
+    void *maxed[3];
+    for (int i = 0; i < 3; i++)
+    {
+        maxed[i] = malloc(MEDIUM_MAX);
+    }
+    if (stat("medium_regions") != regions)
+    {
+        fprintf(stderr, "\nshrunk medium run kept its trailing pages");
+        return 1;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        free(maxed[i]);
+    }
+    free(shrunk);
+
+    return 0;
+}
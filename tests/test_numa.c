@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+int csemalloc_set_option(const char *name, long value);
+int csemalloc_stat(const char *name, size_t *value);
+
+#define ALLOC_SIZE 100
+#define MEDIUM_SIZE (8 << 10)
+#define REGION_SHIFT 22
+#define NTHREADS 2
+#define NBLOCKS 64
+#define ROUNDS 8
+#define FORKS 20
+#define CHUNK_SIZE 4096
+#define POOL_CHUNKS 256
+
+static void *blocks[NTHREADS][NBLOCKS];
+static pthread_barrier_t barrier;
+static int failed;
+static volatile int stop;
+static void *pool[NTHREADS][POOL_CHUNKS];
+
+/* Each thread allocates from the arena of its own (fake) node, then
+ * frees the blocks of the other thread, so every free is cross-node. */
+static void *worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    csemalloc_set_option("thread_node", id);
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < NBLOCKS; i++)
+        {
+            size_t size = 16 + (i * 97 + round * 13) % 6000;
+            blocks[id][i] = malloc(size);
+            memset(blocks[id][i], id + 1, size);
+        }
+        pthread_barrier_wait(&barrier);
+        for (int i = 0; i < NBLOCKS; i++)
+        {
+            if (*(unsigned char *)blocks[1 - id][i] != 2 - id)
+            {
+                failed = 1;
+            }
+            free(blocks[1 - id][i]);
+        }
+        pthread_barrier_wait(&barrier);
+    }
+    return NULL;
+}
+
+/* Allocate and free on both nodes until told to stop, so that arena
+ * and heap locks are often held when the main thread forks. */
+static void *churner(void *arg)
+{
+    for (int i = 0; !stop; i++)
+    {
+        csemalloc_set_option("thread_node", i % NTHREADS);
+        free(malloc(16 + (i * 97) % 6000));
+        free(malloc(MEDIUM_SIZE));
+    }
+    return NULL;
+}
+
+/* This test fakes a two node topology and checks that each node gets
+ * its own arena, that a block freed on another node goes back to the
+ * arena that owns it, that both arenas survive concurrent use, and
+ * that a child forked during it can allocate. */
+int main(int argc, char *argv[])
+{
+    csemalloc_set_option("numa_nodes", 2);
+
+    /* A block freed on node 0 must not be handed to node 1. */
+    csemalloc_set_option("thread_node", 0);
+    void *p = malloc(ALLOC_SIZE);
+    uintptr_t p0 = (uintptr_t)p;
+    free(p);
+    csemalloc_set_option("thread_node", 1);
+    uintptr_t p1 = (uintptr_t)malloc(ALLOC_SIZE);
+    if (p1 == p0)
+    {
+        fprintf(stderr, "\nnode 1 reused a free block of node 0");
+        return 1;
+    }
+
+    /* A node 0 block freed on node 1 returns to node 0. */
+    csemalloc_set_option("thread_node", 0);
+    void *x = malloc(ALLOC_SIZE);
+    uintptr_t x0 = (uintptr_t)x;
+    csemalloc_set_option("thread_node", 1);
+    free(x);
+    uintptr_t x1 = (uintptr_t)malloc(ALLOC_SIZE);
+    csemalloc_set_option("thread_node", 0);
+    uintptr_t y0 = (uintptr_t)malloc(ALLOC_SIZE);
+    if (x1 == x0 || y0 != x0)
+    {
+        fprintf(stderr, "\ncross-node free did not return to owner");
+        fprintf(stderr, "\nx0: %lx, x1: %lx, y0: %lx", x0, x1, y0);
+        return 1;
+    }
+
+    /* Each node grows its pool by slabs of many chunks, not chunk by
+     * chunk; a slab costs at most two sbrk() calls. */
+    size_t sbrks;
+    csemalloc_stat("sbrk_calls", &sbrks);
+    for (int node = 0; node < NTHREADS; node++)
+    {
+        csemalloc_set_option("thread_node", node);
+        for (int i = 0; i < POOL_CHUNKS; i++)
+        {
+            pool[node][i] = malloc(CHUNK_SIZE - 8);
+        }
+    }
+    size_t grown;
+    csemalloc_stat("sbrk_calls", &grown);
+    if (grown - sbrks > 2 * NTHREADS)
+    {
+        fprintf(stderr, "\n%d chunks per node took %zu sbrk() calls",
+                POOL_CHUNKS, grown - sbrks);
+        return 1;
+    }
+    for (int node = 0; node < NTHREADS; node++)
+    {
+        for (int i = 0; i < POOL_CHUNKS; i++)
+        {
+            free(pool[node][i]);
+        }
+    }
+    csemalloc_set_option("thread_node", 0);
+
+    /* Medium allocations of different nodes use different regions. */
+    void *m0 = malloc(MEDIUM_SIZE);
+    csemalloc_set_option("thread_node", 1);
+    void *m1 = malloc(MEDIUM_SIZE);
+    if ((uintptr_t)m0 >> REGION_SHIFT == (uintptr_t)m1 >> REGION_SHIFT)
+    {
+        fprintf(stderr, "\nnodes share a medium region");
+        return 1;
+    }
+    free(m0);
+    free(m1);
+
+    pthread_t threads[NTHREADS];
+    pthread_barrier_init(&barrier, NULL, NTHREADS);
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < NTHREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    if (failed)
+    {
+        fprintf(stderr, "\nconcurrent arenas corrupted a block");
+        return 1;
+    }
+
+    /* A child forked while another thread allocates can allocate. */
+    pthread_t churn;
+    pthread_create(&churn, NULL, churner, NULL);
+    for (int i = 0; i < FORKS; i++)
+    {
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            alarm(5);
+            for (int node = 0; node < NTHREADS; node++)
+            {
+                csemalloc_set_option("thread_node", node);
+                free(malloc(ALLOC_SIZE));
+                free(malloc(MEDIUM_SIZE));
+            }
+            _exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "\nchild %d could not allocate after fork()", i);
+            stop = 1;
+            return 1;
+        }
+    }
+    stop = 1;
+    pthread_join(churn, NULL);
+
+    return 0;
+}
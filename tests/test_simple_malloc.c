@@ -94,8 +94,8 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    void *p6 = realloc(p2, REALLOC_SIZE_2);
-    fprintf(stderr, "\np2: %p, p6: %p", p2, p6);
+    void *p6 = realloc(p5, REALLOC_SIZE_2);
+    fprintf(stderr, "\np6: %p", p6);
 
     // check realloc copies memory
     for (int i = 0; i < ALLOC_SIZE; i++)